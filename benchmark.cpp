@@ -0,0 +1,374 @@
+// Benchmark suite for longest-path.
+// Generates graphs of several families and sizes with ./generate, runs ./longest-path on them with each engine,
+// and reports the median time, throughput and peak memory use.
+//
+// License: MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// Configuration
+// -----------------------------------------------------------------------------
+
+struct Engine {
+  string name;
+  vector<string> args; // arguments to longest-path, before the problem and file
+  long max_edges;      // don't bother with larger graphs
+};
+
+const Engine default_engines[] = {
+  {"fast",     {"fast"},                    10000000},
+  {"dijkstra", {"--sssp=dijkstra", "fast"}, 10000000}, // without BFS, buckets or Floyd-Warshall
+  {"ch",       {"--sssp=ch", "fast"},       10000000}, // contraction hierarchy
+  {"delta",    {"--sssp=delta", "fast"},    10000000}, // parallel delta-stepping, use with --threads
+  {"brute",    {"brute"},                   100},
+  {"directed", {"--directed", "fast"},      10000000}, // the edges of the graph as arcs, with a min cost flow
+  {"directed-brute", {"--directed", "brute"}, 100},
+  {"postman",  {"--mode=postman", "fast"},  10000000}, // shortest walk that covers every edge, a different answer
+};
+
+// Phases of longest-path that are reported separately, if an engine has them
+const char* reported_phases[] = {"ch-build", "ch-query"};
+
+const char* default_families[] = {"domino", "unit-domino", "multi", "grid", "geometric", "powerlaw"};
+
+// Families that are generated with extra options
+struct FamilyVariant {
+  const char* name;
+  const char* family;
+  vector<string> options;
+};
+const FamilyVariant family_variants[] = {
+  {"unit-domino", "domino", {"--weights=unit"}},
+};
+
+struct Options {
+  vector<string> families;
+  vector<long>   sizes;
+  vector<Engine> engines;
+  vector<int>    threads; // run every engine with each of these thread counts
+  int      repeat  = 5;
+  int      timeout = 60; // seconds, per run
+  unsigned seed    = 1;
+  string   data_dir = "bench-data";
+  string   program  = "./longest-path";
+  string   generator = "./generate";
+  string   json_file; // also write results as JSON
+};
+
+// Result of running one engine on one graph
+struct Measurement {
+  string family;
+  long   edges;
+  string engine;
+  string status; // "ok", "timeout" or "failed"
+  vector<double> seconds;
+  long   peak_rss_kb;
+  string answer;
+  map<string,vector<double>> phase_seconds;
+};
+
+vector<string> split(string const& str, char sep) {
+  vector<string> parts;
+  size_t start = 0;
+  while (true) {
+    size_t end = str.find(sep, start);
+    parts.push_back(str.substr(start, end - start));
+    if (end == string::npos) break;
+    start = end + 1;
+  }
+  return parts;
+}
+
+// -----------------------------------------------------------------------------
+// Running programs
+// -----------------------------------------------------------------------------
+
+struct RunResult {
+  bool   ok;
+  bool   timed_out;
+  double seconds;
+  long   peak_rss_kb;
+  string output;
+};
+
+// Run a program, with stdout redirected to a file, or captured if out_file is empty
+RunResult run(vector<string> const& args, string const& out_file, int timeout) {
+  RunResult result = {false, false, 0, 0, ""};
+  int pipe_fds[2] = {-1, -1};
+  if (out_file.empty() && pipe(pipe_fds) != 0) {
+    perror("pipe");
+    return result;
+  }
+  auto start = chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    // child
+    int fd;
+    if (out_file.empty()) {
+      close(pipe_fds[0]);
+      fd = pipe_fds[1];
+    } else {
+      fd = open(out_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) _exit(127);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    vector<char*> argv;
+    for (auto const& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    alarm(timeout); // the alarm survives exec, and kills the program
+    execv(argv[0], argv.data());
+    _exit(127);
+  } else if (pid < 0) {
+    perror("fork");
+    return result;
+  }
+  if (out_file.empty()) {
+    close(pipe_fds[1]);
+    char buf[4096];
+    ssize_t len;
+    while ((len = read(pipe_fds[0], buf, sizeof(buf))) > 0) {
+      result.output.append(buf, len);
+    }
+    close(pipe_fds[0]);
+  }
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  result.seconds     = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  result.peak_rss_kb = usage.ru_maxrss;
+  result.timed_out   = WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM;
+  result.ok          = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  return result;
+}
+
+bool file_exists(string const& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+// Path of a generated graph, generated if it doesn't exist yet
+string graph_file(Options const& opt, string const& family, long size) {
+  string path = opt.data_dir + "/" + family + "-" + to_string(size) + "-" + to_string(opt.seed) + ".txt";
+  if (!file_exists(path)) {
+    mkdir(opt.data_dir.c_str(), 0755);
+    vector<string> args = {opt.generator, family, to_string(size), to_string(opt.seed)};
+    for (auto const& variant : family_variants) {
+      if (family == variant.name) {
+        args[1] = variant.family;
+        args.insert(args.end(), variant.options.begin(), variant.options.end());
+      }
+    }
+    RunResult gen = run(args, path + ".tmp", 0);
+    if (!gen.ok || rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+      fprintf(stderr, "Failed to generate %s\n", path.c_str());
+      exit(EXIT_FAILURE);
+    }
+  }
+  return path;
+}
+
+// Answer in the JSON output of longest-path, as text
+string find_answer(string const& output) {
+  const string prefix = "\"answer\": ";
+  size_t pos = output.find(prefix);
+  if (pos == string::npos) return "?";
+  pos += prefix.size();
+  size_t end = output.find('\n', pos);
+  if (end != string::npos && end > pos && output[end - 1] == ',') end--;
+  return output.substr(pos, end - pos);
+}
+
+// Time spent in a phase, from the JSON output of longest-path, or -1 if the phase didn't run
+double find_phase_seconds(string const& output, string const& phase) {
+  const string prefix = "\"" + phase + "\": {\"seconds\": ";
+  size_t pos = output.find(prefix);
+  if (pos == string::npos) return -1;
+  return atof(output.c_str() + pos + prefix.size());
+}
+
+string json_escape(string const& str) {
+  string out;
+  for (char c : str) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += c;
+  }
+  return out;
+}
+
+double median(vector<double> xs) {
+  if (xs.empty()) return 0;
+  sort(xs.begin(), xs.end());
+  size_t n = xs.size();
+  return n % 2 ? xs[n/2] : (xs[n/2 - 1] + xs[n/2]) / 2;
+}
+
+// Results as JSON, these can be compared with ./compare
+void write_json(FILE* out, Options const& opt, vector<Measurement> const& results) {
+  fprintf(out, "{\n");
+  fprintf(out, "  \"seed\": %u,\n", opt.seed);
+  fprintf(out, "  \"repeat\": %d,\n", opt.repeat);
+  fprintf(out, "  \"results\": [");
+  for (size_t k = 0; k < results.size(); ++k) {
+    Measurement const& m = results[k];
+    double t = median(m.seconds);
+    fprintf(out, "%s\n    {\"family\": \"%s\", \"edges\": %ld, \"engine\": \"%s\", \"status\": \"%s\", ",
+            k ? "," : "", m.family.c_str(), m.edges, m.engine.c_str(), m.status.c_str());
+    fprintf(out, "\"median_seconds\": %.9f, \"edges_per_second\": %.1f, \"peak_rss_kb\": %ld, \"answer\": \"%s\", \"seconds\": [",
+            t, t > 0 ? m.edges / t : 0.0, m.peak_rss_kb, json_escape(m.answer).c_str());
+    for (size_t r = 0; r < m.seconds.size(); ++r) {
+      fprintf(out, "%s%.9f", r ? ", " : "", m.seconds[r]);
+    }
+    fprintf(out, "]");
+    if (!m.phase_seconds.empty()) {
+      fprintf(out, ", \"phase_median_seconds\": {");
+      bool first = true;
+      for (auto const& p : m.phase_seconds) {
+        fprintf(out, "%s\"%s\": %.9f", first ? "" : ", ", p.first.c_str(), median(p.second));
+        first = false;
+      }
+      fprintf(out, "}");
+    }
+    fprintf(out, "}");
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+// -----------------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------------
+
+int main(int argc, const char** argv) {
+  Options opt;
+  for (int a = 1; a < argc; ++a) {
+    string arg = argv[a];
+    size_t eq = arg.find('=');
+    string key = arg.substr(0, eq);
+    string value = eq == string::npos ? "" : arg.substr(eq + 1);
+    if (key == "--families") {
+      opt.families = split(value, ',');
+    } else if (key == "--sizes") {
+      for (auto const& s : split(value, ',')) opt.sizes.push_back(atol(s.c_str()));
+    } else if (key == "--engines") {
+      for (auto const& name : split(value, ',')) {
+        bool found = false;
+        for (auto const& engine : default_engines) {
+          if (engine.name == name) { opt.engines.push_back(engine); found = true; }
+        }
+        if (!found) {
+          fprintf(stderr, "Unknown engine: %s\n", name.c_str());
+          return EXIT_FAILURE;
+        }
+      }
+    } else if (key == "--threads") {
+      for (auto const& t : split(value, ',')) opt.threads.push_back(max(1, atoi(t.c_str())));
+    } else if (key == "--repeat") {
+      opt.repeat = max(1, atoi(value.c_str()));
+    } else if (key == "--timeout") {
+      opt.timeout = atoi(value.c_str());
+    } else if (key == "--seed") {
+      opt.seed = (unsigned)atol(value.c_str());
+    } else if (key == "--data-dir") {
+      opt.data_dir = value;
+    } else if (key == "--json") {
+      opt.json_file = value;
+    } else {
+      fprintf(stderr, "Usage: %s [--families=F,..] [--sizes=N,..] [--engines=E,..] [--threads=N,..] [--repeat=N] [--timeout=SECONDS] [--seed=N] [--data-dir=DIR] [--json=FILE]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (opt.families.empty()) opt.families.assign(begin(default_families), end(default_families));
+  if (opt.sizes.empty()) {
+    for (long size = 100; size <= 10000000; size *= 10) opt.sizes.push_back(size);
+  }
+  if (opt.engines.empty()) opt.engines.assign(begin(default_engines), end(default_engines));
+  if (!opt.threads.empty()) {
+    // engine "delta" with 4 threads becomes "delta-t4"
+    vector<Engine> engines;
+    for (auto const& engine : opt.engines) {
+      for (int t : opt.threads) {
+        Engine e = engine;
+        e.name += "-t" + to_string(t);
+        e.args.insert(e.args.begin(), "--threads=" + to_string(t));
+        engines.push_back(e);
+      }
+    }
+    opt.engines = engines;
+  }
+
+  vector<Measurement> results;
+  printf("%-10s %9s %-8s %12s %14s %13s  %s\n", "family", "edges", "engine", "median (ms)", "edges/s", "peak RSS (MB)", "answer");
+  for (auto const& family : opt.families) {
+    // once an engine times out on a family, larger graphs will only be slower
+    map<string,bool> gave_up;
+    for (long size : opt.sizes) {
+      bool any = false;
+      for (auto const& engine : opt.engines) {
+        any |= size <= engine.max_edges && !gave_up[engine.name];
+      }
+      if (!any) continue;
+      string file = graph_file(opt, family, size);
+      for (auto const& engine : opt.engines) {
+        if (size > engine.max_edges || gave_up[engine.name]) continue;
+        vector<string> args = {opt.program, "--json"};
+        args.insert(args.end(), engine.args.begin(), engine.args.end());
+        args.push_back("1");
+        args.push_back(file);
+        Measurement m = {family, size, engine.name, "ok", {}, 0, "?"};
+        for (int r = 0; r < opt.repeat; ++r) {
+          RunResult result = run(args, "", opt.timeout);
+          if (!result.ok) {
+            m.status = result.timed_out ? "timeout" : "failed";
+            gave_up[engine.name] = true;
+            break;
+          }
+          m.seconds.push_back(result.seconds);
+          m.peak_rss_kb = max(m.peak_rss_kb, result.peak_rss_kb);
+          m.answer = find_answer(result.output);
+          for (const char* phase : reported_phases) {
+            double seconds = find_phase_seconds(result.output, phase);
+            if (seconds >= 0) m.phase_seconds[phase].push_back(seconds);
+          }
+        }
+        results.push_back(m);
+        if (m.status != "ok") {
+          printf("%-10s %9ld %-8s %s\n", family.c_str(), size, engine.name.c_str(), m.status.c_str());
+          continue;
+        }
+        double t = median(m.seconds);
+        printf("%-10s %9ld %-8s %12.3f %14.0f %13.1f  %s", family.c_str(), size, engine.name.c_str(),
+               t * 1e3, size / t, m.peak_rss_kb / 1024.0, m.answer.c_str());
+        for (auto const& p : m.phase_seconds) {
+          printf("  %s: %.3f ms", p.first.c_str(), median(p.second) * 1e3);
+        }
+        printf("\n");
+        fflush(stdout);
+      }
+    }
+  }
+
+  if (!opt.json_file.empty()) {
+    FILE* out = fopen(opt.json_file.c_str(), "w");
+    if (!out) {
+      perror(opt.json_file.c_str());
+      return EXIT_FAILURE;
+    }
+    write_json(out, opt, results);
+    fclose(out);
+  }
+}
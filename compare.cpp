@@ -0,0 +1,204 @@
+// Compare two sets of benchmark results, as written by ./benchmark --json=FILE.
+// Reports the change in time and memory for each benchmark, and flags regressions above a threshold.
+// Exits with status 1 if there are regressions, so this can be used in scripts.
+//
+// License: MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// JSON
+// -----------------------------------------------------------------------------
+
+// Just enough JSON to read the benchmark results
+struct Json {
+  enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+  double number = 0;
+  string str;
+  vector<Json> items;
+  map<string,Json> members;
+
+  Json const& operator [] (string const& key) const {
+    static const Json null;
+    auto it = members.find(key);
+    return it == members.end() ? null : it->second;
+  }
+};
+
+struct JsonParser {
+  string const& text;
+  size_t pos;
+
+  JsonParser(string const& text) : text(text), pos(0) {}
+
+  void skip_space() {
+    while (pos < text.size() && isspace((unsigned char)text[pos])) pos++;
+  }
+  void expect(char c) {
+    skip_space();
+    if (pos >= text.size() || text[pos] != c) {
+      throw string("Expected '") + c + "' at position " + to_string(pos);
+    }
+    pos++;
+  }
+  bool try_parse(char c) {
+    skip_space();
+    if (pos < text.size() && text[pos] == c) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+  string parse_string() {
+    expect('"');
+    string out;
+    while (pos < text.size() && text[pos] != '"') {
+      if (text[pos] == '\\' && pos + 1 < text.size()) pos++;
+      out += text[pos++];
+    }
+    expect('"');
+    return out;
+  }
+  Json parse() {
+    Json value;
+    skip_space();
+    if (pos >= text.size()) throw string("Unexpected end of input");
+    char c = text[pos];
+    if (c == '{') {
+      value.type = Json::OBJECT;
+      pos++;
+      if (try_parse('}')) return value;
+      do {
+        string key = parse_string();
+        expect(':');
+        value.members[key] = parse();
+      } while (try_parse(','));
+      expect('}');
+    } else if (c == '[') {
+      value.type = Json::ARRAY;
+      pos++;
+      if (try_parse(']')) return value;
+      do {
+        value.items.push_back(parse());
+      } while (try_parse(','));
+      expect(']');
+    } else if (c == '"') {
+      value.type = Json::STRING;
+      value.str = parse_string();
+    } else if (text.compare(pos, 4, "true") == 0 || text.compare(pos, 5, "false") == 0) {
+      value.type = Json::BOOL;
+      value.number = c == 't';
+      pos += c == 't' ? 4 : 5;
+    } else if (text.compare(pos, 4, "null") == 0) {
+      pos += 4;
+    } else {
+      value.type = Json::NUMBER;
+      char* end;
+      value.number = strtod(text.c_str() + pos, &end);
+      if (end == text.c_str() + pos) throw string("Unexpected character at position ") + to_string(pos);
+      pos = end - text.c_str();
+    }
+    return value;
+  }
+};
+
+Json read_json_file(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  string text;
+  char buf[4096];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, len);
+  fclose(f);
+  try {
+    return JsonParser(text).parse();
+  } catch (string const& err) {
+    fprintf(stderr, "%s: %s\n", path, err.c_str());
+    exit(EXIT_FAILURE);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Comparison
+// -----------------------------------------------------------------------------
+
+string result_key(Json const& r) {
+  return r["family"].str + "/" + to_string((long)r["edges"].number) + "/" + r["engine"].str;
+}
+
+int main(int argc, const char** argv) {
+  double threshold = 0.10;      // relative slowdown that counts as a regression
+  double min_seconds = 0.001;   // times below this are noise
+  vector<const char*> files;
+  for (int a = 1; a < argc; ++a) {
+    string arg = argv[a];
+    if (arg.compare(0, 12, "--threshold=") == 0) {
+      threshold = atof(argv[a] + 12);
+    } else if (arg.compare(0, 14, "--min-seconds=") == 0) {
+      min_seconds = atof(argv[a] + 14);
+    } else {
+      files.push_back(argv[a]);
+    }
+  }
+  if (files.size() != 2) {
+    fprintf(stderr, "Usage: %s [--threshold=FRACTION] [--min-seconds=SECONDS] BASELINE.json CURRENT.json\n", argv[0]);
+    return 2;
+  }
+  Json baseline = read_json_file(files[0]);
+  Json current  = read_json_file(files[1]);
+
+  map<string,Json const*> base_results;
+  for (auto const& r : baseline["results"].items) {
+    base_results[result_key(r)] = &r;
+  }
+
+  int regressions = 0, improvements = 0;
+  printf("%-32s %12s %12s %9s %9s  %s\n", "benchmark", "base (ms)", "new (ms)", "time", "memory", "");
+  for (auto const& cur : current["results"].items) {
+    string key = result_key(cur);
+    auto it = base_results.find(key);
+    if (it == base_results.end()) {
+      printf("%-32s %12s %12s %9s %9s  new\n", key.c_str(), "-", "", "", "");
+      continue;
+    }
+    Json const& base = *it->second;
+    bool base_ok = base["status"].str == "ok";
+    bool cur_ok  = cur["status"].str == "ok";
+    if (!base_ok || !cur_ok) {
+      const char* verdict = "";
+      if (base_ok && !cur_ok) { verdict = "REGRESSION"; regressions++; }
+      if (!base_ok && cur_ok) { verdict = "improvement"; improvements++; }
+      printf("%-32s %12s %12s %9s %9s  %s\n", key.c_str(), base["status"].str.c_str(), cur["status"].str.c_str(), "", "", verdict);
+      continue;
+    }
+    double t0 = base["median_seconds"].number, t1 = cur["median_seconds"].number;
+    double m0 = base["peak_rss_kb"].number,    m1 = cur["peak_rss_kb"].number;
+    double time_change = t0 > 0 ? t1 / t0 - 1 : 0;
+    double mem_change  = m0 > 0 ? m1 / m0 - 1 : 0;
+    bool noise = max(t0, t1) < min_seconds;
+    string verdict;
+    if (base["answer"].str != cur["answer"].str) {
+      verdict = "WRONG ANSWER (" + base["answer"].str + " vs " + cur["answer"].str + ")";
+      regressions++;
+    } else if ((!noise && time_change > threshold) || mem_change > threshold) {
+      verdict = "REGRESSION";
+      regressions++;
+    } else if (!noise && time_change < -threshold) {
+      verdict = "improvement";
+      improvements++;
+    }
+    printf("%-32s %12.3f %12.3f %+8.1f%% %+8.1f%%  %s\n", key.c_str(), t0 * 1e3, t1 * 1e3, time_change * 100, mem_change * 100, verdict.c_str());
+  }
+  printf("%d regressions, %d improvements (threshold %.0f%%)\n", regressions, improvements, threshold * 100);
+  return regressions > 0 ? 1 : 0;
+}
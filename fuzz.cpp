@@ -0,0 +1,446 @@
+// Differential fuzzing of longest-path.
+// Generates random small multigraphs, and compares the answer of every engine with the brute force solution.
+// Inputs where they disagree are minimized and saved, like bad-input.
+// The time of each run is recorded too, so that inputs where an engine is unusually slow are found as well.
+//
+// License: MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// Configuration
+// -----------------------------------------------------------------------------
+
+// What an engine needs to run on the fuzzed graphs, others are skipped
+enum Needs {
+  NEEDS_UNDIRECTED   = 1,
+  NEEDS_UNIT_WEIGHTS = 2, // --max-weight=1
+  NEEDS_PROBLEM_1    = 4, // problem 2 always uses the lex cost type
+};
+
+struct Engine {
+  string name;
+  string args; // arguments to longest-path, before the problem and file
+  int    needs;
+};
+
+const Engine reference_engine = {"brute", "brute", 0};
+const Engine default_engines[] = {
+  {"fast",     "fast",                           0},
+  {"dijkstra", "--sssp=dijkstra fast",           0},
+  {"bfs",      "--sssp=bfs fast",                NEEDS_UNIT_WEIGHTS},
+  {"buckets",  "--sssp=buckets fast",            NEEDS_PROBLEM_1},
+  {"floyd",    "--sssp=floyd fast",              NEEDS_PROBLEM_1},
+  {"ch",       "--sssp=ch fast",                 NEEDS_UNDIRECTED},
+  {"delta",    "--sssp=delta --threads=3 fast",  0},
+  {"lru",      "--tree-cache=0.0001 fast",       0},
+  {"int64",    "--cost=int64 fast",              NEEDS_PROBLEM_1},
+  {"double",   "--cost=double fast",             NEEDS_PROBLEM_1},
+  {"checked32", "--cost=checked32 fast",         NEEDS_PROBLEM_1},
+  {"checked64", "--cost=checked64 fast",         NEEDS_PROBLEM_1},
+};
+
+struct Options {
+  int    runs = 1000;
+  uint64_t seed = 1;
+  int    max_nodes = 6;
+  int    max_edges = 8;
+  int    max_weight = 10;
+  int    max_capacity = 1;      // some edges can be used up to this many times
+  int    problem = 1;           // 2 compares the lex cost type, (edges, weight)
+  bool   allow_shorter = false; // don't fail if an engine finds a shorter path, this is a known limitation, except in postman mode
+  bool   directed = false;      // the graphs are directed, pass --directed to every engine
+  string mode = "path";         // passed as --mode to every engine
+  bool   sensitivity = false;   // pass --sensitivity, and compare the answers without each edge too
+  double outlier_factor = 10;   // runs slower than this times the median are outliers
+  int    timeout = 10;          // seconds, a run that takes longer is killed and reported as slow
+  vector<Engine> engines;
+  string program = "./longest-path";
+  string out_dir = "fuzz-output";
+};
+
+// -----------------------------------------------------------------------------
+// Graphs
+// -----------------------------------------------------------------------------
+
+struct Edge {
+  int from, to, cost, capacity;
+};
+typedef vector<Edge> Graph;
+
+Graph random_graph(mt19937_64& rng, Options const& opt) {
+  int n = 1 + (int)(rng() % opt.max_nodes);
+  int m = 1 + (int)(rng() % opt.max_edges);
+  Graph graph;
+  for (int k = 0; k < m; ++k) {
+    // the first edge starts at node 0, because that is where longest-path starts
+    int i = k == 0 ? 0 : (int)(rng() % n);
+    int j = (int)(rng() % n);
+    int cost = 1 + (int)(rng() % opt.max_weight);
+    // a quarter of the edges get a capacity, without changing the graphs for a seed if there are none
+    int capacity = opt.max_capacity > 1 && rng() % 4 == 0 ? 2 + (int)(rng() % (opt.max_capacity - 1)) : 1;
+    graph.push_back(Edge{i, j, cost, capacity});
+  }
+  return graph;
+}
+
+bool can_run(Options const& opt, Engine const& engine) {
+  if ((engine.needs & NEEDS_UNDIRECTED) && opt.directed) return false;
+  if ((engine.needs & NEEDS_UNIT_WEIGHTS) && opt.max_weight != 1) return false;
+  if ((engine.needs & NEEDS_PROBLEM_1) && opt.problem != 1) return false;
+  return true;
+}
+
+bool has_node_zero(Graph const& graph) {
+  for (auto const& e : graph) {
+    if (e.from == 0 || e.to == 0) return true;
+  }
+  return false;
+}
+
+void write_graph(string const& path, Graph const& graph) {
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) {
+    perror(path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  for (auto const& e : graph) {
+    if (e.capacity > 1) {
+      fprintf(f, "%d/%d@%d*%d\n", e.from, e.to, e.cost, e.capacity);
+    } else {
+      fprintf(f, "%d/%d@%d\n", e.from, e.to, e.cost);
+    }
+  }
+  fclose(f);
+}
+
+// -----------------------------------------------------------------------------
+// Running engines
+// -----------------------------------------------------------------------------
+
+struct RunResult {
+  bool   ok;
+  bool   timed_out;
+  long   answer;
+  double seconds; // time spent in the algorithm, as reported by longest-path --json
+};
+
+// Sum of all numbers following a key in a JSON text
+double sum_json_numbers(string const& json, string const& key) {
+  double total = 0;
+  string pattern = "\"" + key + "\": ";
+  for (size_t pos = json.find(pattern); pos != string::npos; pos = json.find(pattern, pos + 1)) {
+    total += atof(json.c_str() + pos + pattern.size());
+  }
+  return total;
+}
+
+// An answer is a number, or {"edges": E, "weight": W} for the lex cost type, which is ordered like E * 2^32 + W
+long parse_answer(const char* text) {
+  long edges, weight;
+  if (sscanf(text, "{\"edges\": %ld, \"weight\": %ld}", &edges, &weight) == 2) return edges * (1L << 32) + weight;
+  return atol(text);
+}
+
+// Run longest-path with stdout captured, it is killed with SIGALRM after the timeout, like in benchmark.cpp
+bool run_program(vector<string> const& args, int timeout, string& output, bool& timed_out) {
+  int pipe_fds[2];
+  if (pipe(pipe_fds) != 0) {
+    perror("pipe");
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    // child, errors of the engines are expected and not shown
+    close(pipe_fds[0]);
+    dup2(pipe_fds[1], STDOUT_FILENO);
+    close(pipe_fds[1]);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) dup2(null_fd, STDERR_FILENO);
+    vector<char*> argv;
+    for (auto const& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    alarm(timeout); // the alarm survives exec, and kills the program
+    execv(argv[0], argv.data());
+    _exit(127);
+  } else if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+  close(pipe_fds[1]);
+  char buf[4096];
+  ssize_t len;
+  while ((len = read(pipe_fds[0], buf, sizeof(buf))) > 0) output.append(buf, len);
+  close(pipe_fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  timed_out = WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+RunResult run_engine(Options const& opt, Engine const& engine, string const& file) {
+  RunResult result = {false, false, 0, 0};
+  vector<string> args = {opt.program, "--json", "--mode=" + opt.mode};
+  if (opt.directed) args.push_back("--directed");
+  if (opt.sensitivity) args.push_back("--sensitivity");
+  for (size_t start = 0; start < engine.args.size(); ) {
+    size_t end = min(engine.args.find(' ', start), engine.args.size());
+    args.push_back(engine.args.substr(start, end - start));
+    start = end + 1;
+  }
+  args.push_back(to_string(opt.problem));
+  args.push_back(file);
+  string output;
+  bool ok = run_program(args, opt.timeout, output, result.timed_out);
+  size_t pos = output.find("\"answer\": ");
+  if (!ok || pos == string::npos) return result;
+  result.ok = true;
+  result.answer = parse_answer(output.c_str() + pos + 10);
+  // with --sensitivity, compare a checksum of the main answer and all answers without an edge
+  if (opt.sensitivity) {
+    result.answer = 0;
+    for (; pos != string::npos; pos = output.find("\"answer\": ", pos + 1)) result.answer += parse_answer(output.c_str() + pos + 10);
+  }
+  // parsing is not part of the algorithm
+  double parse = 0;
+  size_t parse_pos = output.find("\"parse\": {\"seconds\": ");
+  if (parse_pos != string::npos) parse = atof(output.c_str() + parse_pos + 22);
+  result.seconds = sum_json_numbers(output, "seconds") - parse;
+  return result;
+}
+
+enum Verdict { AGREE, SHORTER, LONGER, CRASH, SLOW };
+const char* verdict_names[] = {"agree", "shorter", "longer", "crash", "slow"};
+
+Verdict compare(RunResult const& reference, RunResult const& result) {
+  if (result.timed_out || reference.timed_out) return SLOW;
+  if (!result.ok || !reference.ok) return CRASH;
+  if (result.answer < reference.answer) return SHORTER;
+  if (result.answer > reference.answer) return LONGER;
+  return AGREE;
+}
+
+Verdict check(Options const& opt, Engine const& engine, Graph const& graph) {
+  // not current.txt, the other engines still have to run on that
+  string file = opt.out_dir + "/minimize.txt";
+  write_graph(file, graph);
+  return compare(run_engine(opt, reference_engine, file), run_engine(opt, engine, file));
+}
+
+// Remove edges and lower weights and capacities, as long as the engine still disagrees in the same way
+Graph minimize(Options const& opt, Engine const& engine, Graph graph, Verdict verdict) {
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    for (size_t k = 0; k < graph.size(); ++k) {
+      Graph smaller = graph;
+      smaller.erase(smaller.begin() + k);
+      if (!smaller.empty() && has_node_zero(smaller) && check(opt, engine, smaller) == verdict) {
+        graph = smaller;
+        progress = true;
+        --k;
+      }
+    }
+    for (size_t k = 0; k < graph.size(); ++k) {
+      if (graph[k].cost == 1) continue;
+      Graph lighter = graph;
+      lighter[k].cost = 1;
+      if (check(opt, engine, lighter) == verdict) {
+        graph = lighter;
+        progress = true;
+      }
+    }
+    for (size_t k = 0; k < graph.size(); ++k) {
+      if (graph[k].capacity == 1) continue;
+      Graph fewer = graph;
+      fewer[k].capacity--;
+      if (check(opt, engine, fewer) == verdict) {
+        graph = fewer;
+        progress = true;
+      }
+    }
+  }
+  return graph;
+}
+
+// -----------------------------------------------------------------------------
+// Statistics
+// -----------------------------------------------------------------------------
+
+double percentile(vector<double> xs, double p) {
+  if (xs.empty()) return 0;
+  sort(xs.begin(), xs.end());
+  size_t k = min(xs.size() - 1, (size_t)(p * xs.size()));
+  return xs[k];
+}
+
+// -----------------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------------
+
+int main(int argc, const char** argv) {
+  Options opt;
+  for (int a = 1; a < argc; ++a) {
+    string arg = argv[a];
+    size_t eq = arg.find('=');
+    string key = arg.substr(0, eq);
+    const char* value = eq == string::npos ? "" : argv[a] + eq + 1;
+    if (key == "--runs") {
+      opt.runs = atoi(value);
+    } else if (key == "--seed") {
+      opt.seed = strtoull(value, nullptr, 10);
+    } else if (key == "--max-nodes") {
+      opt.max_nodes = max(1, atoi(value));
+    } else if (key == "--max-edges") {
+      opt.max_edges = max(1, atoi(value));
+    } else if (key == "--max-weight") {
+      opt.max_weight = max(1, atoi(value));
+    } else if (key == "--max-capacity") {
+      opt.max_capacity = max(1, atoi(value));
+    } else if (key == "--problem") {
+      opt.problem = atoi(value) == 2 ? 2 : 1;
+    } else if (key == "--allow-shorter") {
+      opt.allow_shorter = true;
+    } else if (key == "--directed") {
+      opt.directed = true;
+    } else if (key == "--mode") {
+      opt.mode = value;
+    } else if (key == "--sensitivity") {
+      opt.sensitivity = true;
+    } else if (key == "--outlier-factor") {
+      opt.outlier_factor = atof(value);
+    } else if (key == "--timeout") {
+      opt.timeout = max(1, atoi(value));
+    } else if (key == "--engines") {
+      string names = value;
+      size_t start = 0;
+      while (start <= names.size()) {
+        size_t end = min(names.find(',', start), names.size());
+        string name = names.substr(start, end - start);
+        bool found = false;
+        for (auto const& engine : default_engines) {
+          if (engine.name == name) { opt.engines.push_back(engine); found = true; }
+        }
+        if (!found) {
+          fprintf(stderr, "Unknown engine: %s\n", name.c_str());
+          return EXIT_FAILURE;
+        }
+        start = end + 1;
+      }
+    } else if (key == "--out-dir") {
+      opt.out_dir = value;
+    } else {
+      fprintf(stderr, "Usage: %s [--runs=N] [--seed=N] [--max-nodes=N] [--max-edges=N] [--max-weight=N] [--max-capacity=N] [--problem=N] [--engines=E,..] [--allow-shorter] [--directed] [--mode=MODE] [--sensitivity] [--outlier-factor=X] [--timeout=SECONDS] [--out-dir=DIR]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (opt.engines.empty()) {
+    for (auto const& engine : default_engines) {
+      if (can_run(opt, engine)) opt.engines.push_back(engine);
+    }
+  }
+  for (auto const& engine : opt.engines) {
+    if (!can_run(opt, engine)) {
+      fprintf(stderr, "Engine %s can't run with these options\n", engine.name.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+  mkdir(opt.out_dir.c_str(), 0755);
+
+  mt19937_64 rng(opt.seed);
+  map<string,map<int,int>> verdicts;     // engine -> verdict -> count
+  map<string,vector<double>> times;      // engine -> seconds per run that finished in time
+  map<string,vector<int>> time_runs;     // engine -> run of each of those times
+  vector<Graph> graphs;                  // graph of every run, to save the outliers
+  int failures = 0;
+  for (int run = 0; run < opt.runs; ++run) {
+    Graph graph = random_graph(rng, opt);
+    string file = opt.out_dir + "/current.txt";
+    write_graph(file, graph);
+    graphs.push_back(graph);
+    RunResult reference = run_engine(opt, reference_engine, file);
+    if (reference.timed_out) {
+      // nothing to compare with, this is not an error of the engines
+      verdicts[reference_engine.name][SLOW]++;
+      string path = opt.out_dir + "/" + reference_engine.name + "-timeout-" + to_string(run) + ".txt";
+      write_graph(path, graph);
+      printf("run %d: brute force took more than %d s, skipped: %s\n", run, opt.timeout, path.c_str());
+      continue;
+    }
+    times[reference_engine.name].push_back(reference.seconds);
+    time_runs[reference_engine.name].push_back(run);
+    // a postman walk shorter than the brute force misses an edge, that is always an error
+    bool allow_shorter = opt.allow_shorter && opt.mode != "postman";
+    for (auto const& engine : opt.engines) {
+      RunResult result = run_engine(opt, engine, file);
+      if (!result.timed_out) {
+        times[engine.name].push_back(result.seconds);
+        time_runs[engine.name].push_back(run);
+      }
+      Verdict verdict = compare(reference, result);
+      verdicts[engine.name][verdict]++;
+      if (verdict == AGREE || (verdict == SHORTER && allow_shorter && verdicts[engine.name][verdict] > 1)) continue;
+      if (verdict == SLOW) {
+        // minimizing would run into the timeout again and again
+        string path = opt.out_dir + "/" + engine.name + "-timeout-" + to_string(run) + ".txt";
+        write_graph(path, graph);
+        printf("run %d: %s took more than %d s: %s\n", run, engine.name.c_str(), opt.timeout, path.c_str());
+        failures++;
+        continue;
+      }
+      // save a minimized input, for SHORTER only the first one if they are allowed
+      Graph small = minimize(opt, engine, graph, verdict);
+      string path = opt.out_dir + "/" + engine.name + "-" + verdict_names[verdict] + "-" + to_string(run) + ".txt";
+      write_graph(path, small);
+      printf("run %d: %s %s than brute force (%ld vs %ld), minimized input with %d edges: %s\n",
+             run, engine.name.c_str(), verdict == CRASH ? "crashed rather" : verdict_names[verdict],
+             result.answer, reference.answer, (int)small.size(), path.c_str());
+      if (verdict != SHORTER || !allow_shorter) failures++;
+    }
+  }
+  remove((opt.out_dir + "/current.txt").c_str());
+  remove((opt.out_dir + "/minimize.txt").c_str());
+
+  printf("\n%-10s %8s %8s %8s %8s %8s %12s %12s %12s %12s\n", "engine", "agree", "shorter", "longer", "crash", "slow", "p50 (us)", "p90 (us)", "p99 (us)", "max (us)");
+  vector<string> names = {reference_engine.name};
+  for (auto const& engine : opt.engines) names.push_back(engine.name);
+  for (auto const& name : names) {
+    auto& v = verdicts[name];
+    auto const& t = times[name];
+    if (name == reference_engine.name) {
+      printf("%-10s %8s %8s %8s %8s %8d", name.c_str(), "-", "-", "-", "-", v[SLOW]);
+    } else {
+      printf("%-10s %8d %8d %8d %8d %8d", name.c_str(), v[AGREE], v[SHORTER], v[LONGER], v[CRASH], v[SLOW]);
+    }
+    printf(" %12.1f %12.1f %12.1f %12.1f\n", percentile(t, 0.5) * 1e6, percentile(t, 0.9) * 1e6, percentile(t, 0.99) * 1e6, percentile(t, 1) * 1e6);
+  }
+  // performance outliers
+  for (auto const& name : names) {
+    auto const& t = times[name];
+    double limit = percentile(t, 0.5) * opt.outlier_factor;
+    int outliers = 0;
+    for (size_t k = 0; k < t.size() && outliers < 10; ++k) {
+      if (t[k] > limit && t[k] > 1e-4) {
+        outliers++;
+        int run = time_runs[name][k];
+        string path = opt.out_dir + "/" + name + "-slow-" + to_string(run) + ".txt";
+        write_graph(path, graphs[run]);
+        printf("outlier: %s took %.1f us on run %d (median %.1f us): %s\n", name.c_str(), t[k] * 1e6, run, percentile(t, 0.5) * 1e6, path.c_str());
+      }
+    }
+  }
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
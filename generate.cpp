@@ -0,0 +1,437 @@
+// Generate reproducible random graphs, for benchmarking longest-path.
+// Output is in the input format of longest-path, one "i/j" or "i/j@cost" edge per line,
+// or in the binary format (see write_binary_header).
+//
+// License: MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// Random numbers
+// -----------------------------------------------------------------------------
+
+// We don't use <random> distributions, since their output differs between standard libraries,
+// and graphs should be the same everywhere for a given seed.
+struct Random {
+  uint64_t state;
+
+  Random(uint64_t seed) : state(seed) {}
+
+  // splitmix64
+  uint64_t next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  // uniform integer in [0,n)
+  int below(int n) {
+    return (int)(next() % (uint64_t)n);
+  }
+  // uniform integer in [lo,hi]
+  int between(int lo, int hi) {
+    return lo + below(hi - lo + 1);
+  }
+  // uniform real in [0,1)
+  double real() {
+    return (next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+};
+
+// -----------------------------------------------------------------------------
+// Graphs
+// -----------------------------------------------------------------------------
+
+const int NO_COST = INT32_MIN; // use implicit cost (sum of the port numbers)
+
+struct Edge {
+  int from, to;
+  int cost;
+};
+
+const int MAX_WEIGHT = 100;
+
+// Connect nodes 0..n-1 with a random spanning tree, so the graph is connected
+void add_random_tree(vector<Edge>& edges, Random& rng, int n) {
+  for (int i = 1; i < n; ++i) {
+    edges.push_back(Edge{rng.below(i), i, rng.between(1,MAX_WEIGHT)});
+  }
+}
+
+// Random multigraph, with on average 8 edge endpoints per node
+vector<Edge> multi_graph(Random& rng, int m) {
+  int n = max(2, m / 4);
+  vector<Edge> edges;
+  add_random_tree(edges, rng, n);
+  while ((int)edges.size() < m) {
+    edges.push_back(Edge{rng.below(n), rng.below(n), rng.between(1,MAX_WEIGHT)});
+  }
+  return edges;
+}
+
+// A square grid, with about m edges
+vector<Edge> grid_graph(Random& rng, int m) {
+  int w = max(2, (int)sqrt(m / 2.0));
+  int h = max(2, (m + 2*w - 1) / (2*w - 1));
+  vector<Edge> edges;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      int i = y * w + x;
+      if (x + 1 < w) edges.push_back(Edge{i, i + 1, rng.between(1,MAX_WEIGHT)});
+      if (y + 1 < h) edges.push_back(Edge{i, i + w, rng.between(1,MAX_WEIGHT)});
+    }
+  }
+  return edges;
+}
+
+// Random geometric graph: points in the unit square, connected if they are close.
+// Weight is proportional to distance.
+vector<Edge> geometric_graph(Random& rng, int m) {
+  int n = max(2, m / 4);
+  // expected number of edges is n^2/2 * pi r^2
+  double r = sqrt(2.0 * m / (M_PI * n * (double)n));
+  vector<double> xs(n), ys(n);
+  for (int i = 0; i < n; ++i) {
+    xs[i] = rng.real();
+    ys[i] = rng.real();
+  }
+  // bucket points in cells of size r
+  int cells = max(1, min((int)(1 / r), 4096));
+  vector<vector<int>> grid(cells * cells);
+  auto cell = [&](double v) { return min(cells - 1, (int)(v * cells)); };
+  for (int i = 0; i < n; ++i) {
+    grid[cell(ys[i]) * cells + cell(xs[i])].push_back(i);
+  }
+  vector<Edge> edges;
+  for (int i = 0; i < n; ++i) {
+    int cx = cell(xs[i]), cy = cell(ys[i]);
+    for (int y = max(0, cy - 1); y <= min(cells - 1, cy + 1); ++y) {
+      for (int x = max(0, cx - 1); x <= min(cells - 1, cx + 1); ++x) {
+        for (int j : grid[y * cells + x]) {
+          if (j <= i) continue;
+          double d = hypot(xs[i] - xs[j], ys[i] - ys[j]);
+          if (d < r) {
+            edges.push_back(Edge{i, j, 1 + (int)(MAX_WEIGHT * d / r)});
+          }
+        }
+      }
+    }
+  }
+  return edges;
+}
+
+// Power law degree distribution, using preferential attachment (Barabasi-Albert)
+vector<Edge> power_law_graph(Random& rng, int m) {
+  const int k = 4; // edges per new node
+  vector<Edge> edges;
+  vector<int> endpoints; // every node appears once for every incident edge
+  edges.push_back(Edge{0, 1, rng.between(1,MAX_WEIGHT)});
+  endpoints.push_back(0);
+  endpoints.push_back(1);
+  for (int i = 2; (int)edges.size() < m; ++i) {
+    for (int e = 0; e < k && (int)edges.size() < m; ++e) {
+      int j = endpoints[rng.below((int)endpoints.size())];
+      edges.push_back(Edge{i, j, rng.between(1,MAX_WEIGHT)});
+      endpoints.push_back(j);
+    }
+    for (int e = 0; e < k; ++e) endpoints.push_back(i);
+  }
+  return edges;
+}
+
+// longest-path starts from node 0, so make sure that it has at least one edge
+void ensure_node_zero(vector<Edge>& edges) {
+  if (edges.empty()) return;
+  for (auto const& e : edges) {
+    if (e.from == 0 || e.to == 0) return;
+  }
+  int swap_with = edges[0].from;
+  for (auto& e : edges) {
+    if      (e.from == swap_with) e.from = 0;
+    else if (e.from == 0)         e.from = swap_with;
+    if      (e.to   == swap_with) e.to   = 0;
+    else if (e.to   == 0)         e.to   = swap_with;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Output
+// -----------------------------------------------------------------------------
+
+// Writing with printf is too slow for very large graphs
+struct Writer {
+  FILE* f;
+  vector<char> buf;
+  size_t pos;
+
+  Writer(FILE* f) : f(f), buf(1 << 16), pos(0) {}
+  ~Writer() { flush(); }
+
+  void flush() {
+    fwrite(buf.data(), 1, pos, f);
+    pos = 0;
+  }
+  // make sure there is room for writing size bytes
+  void reserve(size_t size) {
+    if (pos + size > buf.size()) flush();
+  }
+  // the put functions assume that there is enough room
+  void put(char c) {
+    buf[pos++] = c;
+  }
+  void put(int x) {
+    char tmp[12];
+    int len = 0;
+    unsigned u = x < 0 ? 0u - (unsigned)x : (unsigned)x;
+    if (x < 0) put('-');
+    do { tmp[len++] = '0' + u % 10; u /= 10; } while (u);
+    while (len) buf[pos++] = tmp[--len];
+  }
+  void put_raw(const void* data, size_t size) {
+    memcpy(&buf[pos], data, size);
+    pos += size;
+  }
+};
+
+// The binary format is the magic string "LPG1", followed by one record per edge, each of three native int32s:
+// from, to, cost. Where a cost of NO_COST (INT32_MIN) means that the cost is implicit, so that -1 is a valid cost.
+const char BINARY_MAGIC[4] = {'L','P','G','1'};
+
+struct EdgeWriter {
+  Writer out;
+  bool binary;
+
+  EdgeWriter(FILE* f, bool binary) : out(f), binary(binary) {
+    if (binary) {
+      out.reserve(sizeof(BINARY_MAGIC));
+      out.put_raw(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    }
+  }
+
+  void write(Edge const& e) {
+    out.reserve(40);
+    if (binary) {
+      int32_t record[3] = {e.from, e.to, e.cost};
+      out.put_raw(record, sizeof(record));
+    } else {
+      out.put(e.from);
+      out.put('/');
+      out.put(e.to);
+      if (e.cost != NO_COST) {
+        out.put('@');
+        out.put(e.cost);
+      }
+      out.put('\n');
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+// Domino inventories
+// -----------------------------------------------------------------------------
+
+// Dominoes as in advent of code 2017 day 24: pairs of port numbers, with duplicates and self loops like 2/2.
+// These are written while they are generated, so we can make inventories larger than memory.
+struct DominoOptions {
+  int    ports      = -1;  // port numbers are 0..ports, default: 3/4 of the number of dominoes
+  double skew       = 0;   // port frequency follows a Zipf distribution with this exponent, 0 for uniform
+  double duplicates = 0;   // fraction of dominoes that are a copy of an earlier one
+  double self_loops = 0;   // fraction of dominoes with the same port on both ends
+  string weights    = "implicit"; // implicit, unit, uniform:LO:HI or exponential:MEAN
+};
+
+// Sample from a discrete distribution in O(1), using Vose's alias method
+struct AliasTable {
+  vector<double> prob;
+  vector<int>    alias;
+
+  AliasTable(vector<double> const& weights) : prob(weights.size()), alias(weights.size()) {
+    int n = (int)weights.size();
+    double total = 0;
+    for (double w : weights) total += w;
+    vector<double> scaled(n);
+    vector<int> small, large;
+    for (int i = 0; i < n; ++i) {
+      scaled[i] = weights[i] * n / total;
+      (scaled[i] < 1 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+      int s = small.back(); small.pop_back();
+      int l = large.back();
+      prob[s] = scaled[s];
+      alias[s] = l;
+      scaled[l] -= 1 - scaled[s];
+      if (scaled[l] < 1) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    for (int i : small) prob[i] = 1;
+    for (int i : large) prob[i] = 1;
+  }
+
+  int sample(Random& rng) const {
+    int i = rng.below((int)prob.size());
+    return rng.real() < prob[i] ? i : alias[i];
+  }
+};
+
+struct WeightDistribution {
+  enum Kind { IMPLICIT, UNIT, UNIFORM, EXPONENTIAL } kind;
+  double a, b;
+
+  WeightDistribution(string const& spec) : kind(IMPLICIT), a(0), b(0) {
+    if (spec == "implicit") {
+      kind = IMPLICIT;
+    } else if (spec == "unit") {
+      kind = UNIT;
+    } else if (sscanf(spec.c_str(), "uniform:%lf:%lf", &a, &b) == 2 && a <= b) {
+      kind = UNIFORM;
+    } else if (sscanf(spec.c_str(), "exponential:%lf", &a) == 1 && a > 0) {
+      kind = EXPONENTIAL;
+    } else {
+      fprintf(stderr, "Invalid weight distribution: %s\n", spec.c_str());
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  int sample(Random& rng) const {
+    switch (kind) {
+      case UNIT:        return 1;
+      case UNIFORM:     return rng.between((int)a, (int)b);
+      case EXPONENTIAL: return 1 + (int)(-a * log(1 - rng.real()));
+      default:          return NO_COST;
+    }
+  }
+};
+
+void write_dominoes(EdgeWriter& out, Random& rng, long m, DominoOptions const& opt) {
+  int ports = opt.ports >= 0 ? opt.ports : max(4, (int)(m * 3 / 4));
+  WeightDistribution weights(opt.weights);
+  // with skew, the most frequent ports are scattered over the port numbers by a fixed permutation
+  vector<double> zipf;
+  if (opt.skew > 0) {
+    for (int r = 0; r <= ports; ++r) zipf.push_back(pow(r + 1, -opt.skew));
+  }
+  AliasTable port_table(zipf.empty() ? vector<double>(1,1.0) : zipf);
+  auto port = [&]() -> int {
+    if (zipf.empty()) return rng.below(ports + 1);
+    uint64_t rank = port_table.sample(rng);
+    return (int)((rank + 1) * 2654435761ULL % (uint64_t)(ports + 1));
+  };
+  // duplicates are copies of recent dominoes
+  const size_t RECENT = 1 << 16;
+  vector<Edge> recent;
+  recent.reserve(RECENT);
+
+  for (long k = 0; k < m; ++k) {
+    Edge e;
+    if (k == 0) {
+      e = Edge{0, ports > 0 ? rng.between(1,ports) : 0, NO_COST}; // there must be a starting domino
+    } else if (opt.duplicates > 0 && !recent.empty() && rng.real() < opt.duplicates) {
+      out.write(recent[rng.below((int)recent.size())]);
+      continue;
+    } else {
+      e.from = port();
+      e.to   = opt.self_loops > 0 && rng.real() < opt.self_loops ? e.from : port();
+    }
+    e.cost = weights.sample(rng);
+    if (opt.duplicates > 0) {
+      if (recent.size() < RECENT) recent.push_back(e);
+      else recent[k % RECENT] = e;
+    }
+    out.write(e);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------------
+
+struct Family {
+  const char* name;
+  vector<Edge> (*generate)(Random& rng, int m);
+};
+const Family families[] = {
+  {"multi",     multi_graph},
+  {"grid",      grid_graph},
+  {"geometric", geometric_graph},
+  {"powerlaw",  power_law_graph},
+};
+
+void usage(const char* program) {
+  fprintf(stderr, "Usage: %s [options] FAMILY EDGES [SEED]\n", program);
+  fprintf(stderr, "Families: domino");
+  for (auto const& family : families) fprintf(stderr, " %s", family.name);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --binary            write the binary format\n");
+  fprintf(stderr, "Options for domino inventories:\n");
+  fprintf(stderr, "  --ports=N           use port numbers 0..N\n");
+  fprintf(stderr, "  --skew=S            port frequencies follow a Zipf distribution with exponent S\n");
+  fprintf(stderr, "  --duplicates=P      fraction of duplicate dominoes\n");
+  fprintf(stderr, "  --self-loops=P      fraction of dominoes like 2/2\n");
+  fprintf(stderr, "  --weights=W         implicit (default), unit, uniform:LO:HI or exponential:MEAN\n");
+}
+
+int main(int argc, const char** argv) {
+  vector<string> args;
+  bool binary = false;
+  DominoOptions domino;
+  for (int a = 1; a < argc; ++a) {
+    string arg = argv[a];
+    size_t eq = arg.find('=');
+    string key = arg.substr(0, eq);
+    const char* value = eq == string::npos ? "" : argv[a] + eq + 1;
+    if (arg == "--binary") {
+      binary = true;
+    } else if (key == "--ports") {
+      domino.ports = atoi(value);
+    } else if (key == "--skew") {
+      domino.skew = atof(value);
+    } else if (key == "--duplicates") {
+      domino.duplicates = atof(value);
+    } else if (key == "--self-loops") {
+      domino.self_loops = atof(value);
+    } else if (key == "--weights") {
+      domino.weights = value;
+    } else if (arg.size() > 2 && arg[0] == '-' && arg[1] == '-') {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.size() < 2) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  string name = args[0];
+  long m = atol(args[1].c_str());
+  uint64_t seed = args.size() >= 3 ? strtoull(args[2].c_str(), nullptr, 10) : 1;
+  Random rng(seed);
+  EdgeWriter out(stdout, binary);
+
+  if (name == "domino") {
+    write_dominoes(out, rng, m, domino);
+    return EXIT_SUCCESS;
+  }
+  for (auto const& family : families) {
+    if (name == family.name) {
+      vector<Edge> edges = family.generate(rng, (int)m);
+      ensure_node_zero(edges);
+      for (auto const& e : edges) out.write(e);
+      return EXIT_SUCCESS;
+    }
+  }
+  fprintf(stderr, "Unknown graph family: %s\n", name.c_str());
+  return EXIT_FAILURE;
+}
@@ -10,12 +10,42 @@
 // available from http://pub.ist.ac.at/~vnk/papers/BLOSSOM5.html
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <string.h>
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <list>
 #include <set>
 #include <queue>
 #include <algorithm>
+#include <chrono>
+#include <new>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <limits>
+#include <type_traits>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
 #include "blossom5-v2.05.src/PerfectMatching.h"
 using namespace std;
 
@@ -23,294 +53,3168 @@ using namespace std;
 // Definitions
 // -----------------------------------------------------------------------------
 
-const bool VERBOSE = false;
+// Costs of edges and paths.
+// Everything that stores costs is templated on the cost type, and all cost types are compiled in.
+// The smallest type that can hold the total weight of the input graph is selected at runtime (see select_cost_type),
+// since a wider type than needed makes the distance tables larger.
+enum CostType {COST_INT32, COST_INT64, COST_DOUBLE, COST_CHECKED32, COST_CHECKED64, COST_LEX, COST_AUTO};
+const char* cost_type_names[] = {"int32", "int64", "double", "checked32", "checked64", "lex", "auto"};
 
-typedef int Cost;
+// Integer cost that throws on overflow instead of wrapping around
+template <typename T>
+struct Checked {
+  T value;
+  Checked(T value = 0) : value(value) {}
+  Checked operator + (Checked b) const {
+    T out;
+    if (__builtin_add_overflow(value, b.value, &out)) throw "Cost overflow";
+    return out;
+  }
+  Checked operator - (Checked b) const {
+    T out;
+    if (__builtin_sub_overflow(value, b.value, &out)) throw "Cost overflow";
+    return out;
+  }
+  Checked operator - () const { return Checked(0) - *this; }
+  Checked operator / (Checked b) const { return value / b.value; }
+  Checked& operator += (Checked b) { return *this = *this + b; }
+  bool operator <  (Checked b) const { return value <  b.value; }
+  bool operator >  (Checked b) const { return value >  b.value; }
+  bool operator == (Checked b) const { return value == b.value; }
+};
+
+// Lexicographic cost: first the number of edges, then the total weight, as needed for problem 2.
+// Both are packed into a single integer key = edges * 2^weight_bits + weight,
+// so adding, negating and comparing costs are single integer operations.
+// weight_bits is chosen at runtime (see select_lex_weight_bits), such that the weight of any set of edges
+// fits in the lower bits without carrying into the edge count.
+struct Lex {
+  int64_t key;
+  static int weight_bits;
+  Lex(int64_t key = 0) : key(key) {}
+  // cost of a single edge
+  static Lex edge(int64_t weight) { return ((int64_t)1 << weight_bits) + weight; }
+  int64_t edges() const { return (key + ((int64_t)1 << (weight_bits - 1))) >> weight_bits; }
+  int64_t weight() const { return key - edges() * ((int64_t)1 << weight_bits); }
+  Lex operator + (Lex b) const { return key + b.key; }
+  Lex operator - (Lex b) const { return key - b.key; }
+  Lex operator - () const { return -key; }
+  Lex operator / (Lex b) const { return key / b.key; }
+  Lex& operator += (Lex b) { key += b.key; return *this; }
+  bool operator <  (Lex b) const { return key <  b.key; }
+  bool operator >  (Lex b) const { return key >  b.key; }
+  bool operator == (Lex b) const { return key == b.key; }
+};
+int Lex::weight_bits = 1;
+
+template <typename T> double cost_to_double(T cost) { return (double)cost; }
+template <typename T> double cost_to_double(Checked<T> cost) { return (double)cost.value; }
+double cost_to_double(Lex cost) { return (double)cost.key; }
+
+template <typename T> string cost_to_string(T cost) { return to_string(cost); }
+template <typename T> string cost_to_string(Checked<T> cost) { return to_string(cost.value); }
+string cost_to_string(double cost) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.15g", cost);
+  return buf;
+}
+string cost_to_string(Lex cost) {
+  return to_string(cost.weight()) + " (" + to_string(cost.edges()) + " edges)";
+}
+
+// Costs in JSON output
+template <typename T> string cost_to_json(T cost) { return cost_to_string(cost); }
+string cost_to_json(Lex cost) {
+  return "{\"edges\": " + to_string(cost.edges()) + ", \"weight\": " + to_string(cost.weight()) + "}";
+}
+
+// Cost of a single edge with the given weight, and the other way around
+template <typename Cost, typename Weight> Cost edge_cost_as(Weight weight) { return Cost(weight); }
+template <> Lex edge_cost_as<Lex,int64_t>(int64_t weight) { return Lex::edge(weight); }
+template <typename T> double edge_weight(T cost) { return cost_to_double(cost); }
+double edge_weight(Lex cost) { return (double)cost.weight(); }
+
+// Cost of n copies of an edge, by doubling, since cost types only have addition
+template <typename Cost> Cost cost_times(Cost cost, int n) {
+  Cost total(0);
+  while (n) {
+    if (n & 1) total += cost;
+    n >>= 1;
+    if (n) cost += cost;
+  }
+  return total;
+}
+
+// integer: edge costs are counted in steps of 1
+template <typename Cost> struct CostTraits;
+template <> struct CostTraits<int32_t>          { static const CostType type = COST_INT32;     static const bool integer = true; };
+template <> struct CostTraits<int64_t>          { static const CostType type = COST_INT64;     static const bool integer = true; };
+template <> struct CostTraits<double>           { static const CostType type = COST_DOUBLE;    static const bool integer = false; };
+template <> struct CostTraits<Checked<int32_t>> { static const CostType type = COST_CHECKED32; static const bool integer = true; };
+template <> struct CostTraits<Checked<int64_t>> { static const CostType type = COST_CHECKED64; static const bool integer = true; };
+template <> struct CostTraits<Lex>              { static const CostType type = COST_LEX;       static const bool integer = false; };
+
+// -----------------------------------------------------------------------------
+// Logging
+// -----------------------------------------------------------------------------
+
+enum LogCategory {
+  LOG_PARSE,
+  LOG_DIJKSTRA,
+  LOG_MATCHING,
+  LOG_MARKING,
+  LOG_BRUTE,
+  LOG_QUERY,
+  NUM_LOG_CATEGORIES
+};
+const char* log_category_names[NUM_LOG_CATEGORIES] = {
+  "parse", "dijkstra", "matching", "marking", "brute", "query"
+};
+
+enum LogLevel {
+  LOG_OFF,
+  LOG_INFO,  // once per run or query
+  LOG_DEBUG, // once per shortest path computation or matched pair
+  LOG_TRACE, // once per edge
+  NUM_LOG_LEVELS
+};
+const char* log_level_names[NUM_LOG_LEVELS] = {
+  "off", "info", "debug", "trace"
+};
+
+// Log level per category, set with --log
+LogLevel log_levels[NUM_LOG_CATEGORIES];
+
+// Log a message, the arguments are only evaluated if the category is enabled at this level
+#define LOG(category, level, ...) \
+  do { if (log_levels[category] >= level) log_message(category, __VA_ARGS__); } while (0)
+
+// Messages are collected in a buffer per thread, and written to stderr when it is full
+struct LogBuffer {
+  vector<char> data;
+  ~LogBuffer() { flush(); }
+  void flush() {
+    if (!data.empty()) {
+      fwrite(data.data(), 1, data.size(), stderr);
+      data.clear();
+    }
+  }
+};
+thread_local LogBuffer log_buffer;
+
+void log_message(LogCategory category, const char* format, ...) {
+  char line[1024];
+  int len = snprintf(line, sizeof(line), "[%s] ", log_category_names[category]);
+  va_list args;
+  va_start(args, format);
+  len += vsnprintf(line + len, sizeof(line) - len, format, args);
+  va_end(args);
+  len = min(len, (int)sizeof(line) - 2);
+  line[len++] = '\n';
+  log_buffer.data.insert(log_buffer.data.end(), line, line + len);
+  if (log_buffer.data.size() > (1 << 16)) log_buffer.flush();
+}
+
+// Parse a log specification like "matching,marking:trace" or "all:debug"
+bool parse_log_spec(string const& spec) {
+  size_t start = 0;
+  while (start <= spec.size()) {
+    size_t end = spec.find(',', start);
+    if (end == string::npos) end = spec.size();
+    string part = spec.substr(start, end - start);
+    size_t colon = part.find(':');
+    string category = part.substr(0, colon);
+    LogLevel level = LOG_DEBUG;
+    if (colon != string::npos) {
+      string level_name = part.substr(colon + 1);
+      int l = 0;
+      while (l < NUM_LOG_LEVELS && level_name != log_level_names[l]) ++l;
+      if (l == NUM_LOG_LEVELS) return false;
+      level = (LogLevel)l;
+    }
+    bool found = false;
+    for (int c = 0; c < NUM_LOG_CATEGORIES; ++c) {
+      if (category == "all" || category == log_category_names[c]) {
+        log_levels[c] = level;
+        found = true;
+      }
+    }
+    if (!found) return false;
+    start = end + 1;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Statistics
+// -----------------------------------------------------------------------------
+
+// Phases of the algorithm that are timed separately.
+// Times are aggregated over all calls, so over all targets in longest_paths.
+enum Phase {
+  PHASE_PARSE,
+  PHASE_BRUTE_FORCE,
+  PHASE_SHORTEST_PATHS,
+  PHASE_EXPOSED,
+  PHASE_MATCHING_SETUP,
+  PHASE_MATCHING_SOLVE,
+  PHASE_MARK_EDGES,
+  PHASE_COMPONENT,
+  PHASE_CH_BUILD,
+  PHASE_CH_QUERY,
+  PHASE_FLOW,
+  PHASE_EULER,
+  NUM_PHASES
+};
+const char* phase_names[NUM_PHASES] = {
+  "parse", "brute-force", "shortest-paths", "exposed-nodes",
+  "matching-setup", "matching-solve", "mark-edges", "component", "ch-build", "ch-query", "min-cost-flow", "euler-walk"
+};
+
+struct PhaseStats {
+  double seconds;
+  long   calls;
+};
+
+// Statistics are only collected if enabled (with --stats), otherwise a timer costs a single branch.
+bool collect_stats = false;
+PhaseStats phase_stats[NUM_PHASES];
+
+// Memory use is only tracked if enabled (with --memory), this implies collect_stats.
+bool collect_memory = false;
+
+struct PhaseMemory {
+  atomic<long> allocations; // calls to operator new, from any thread
+  atomic<long> bytes;       // bytes allocated with operator new
+  long rss_growth_kb;       // increase of the peak resident set size
+};
+// the last entry is for allocations outside any phase
+PhaseMemory phase_memory[NUM_PHASES + 1];
+// phase of the innermost timer of this thread, worker threads take it over from the thread that started them
+thread_local int current_phase = NUM_PHASES;
+
+long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+typedef chrono::steady_clock Clock;
+
+// Tracing: record every timed scope as an event in the Chrome trace format (chrome://tracing or ui.perfetto.dev).
+// Each thread has its own buffer, so threads don't have to wait for each other.
+bool collect_trace = false;
+const Clock::time_point trace_epoch = Clock::now();
+
+struct TraceEvent {
+  const char* name;
+  long   arg;         // node this event is about, or -1
+  double start_us;
+  double duration_us;
+};
+
+struct TraceBuffer {
+  int tid;
+  vector<TraceEvent> events;
+};
+
+mutex trace_buffers_mutex;
+vector<unique_ptr<TraceBuffer>> trace_buffers;
+
+TraceBuffer& thread_trace_buffer() {
+  thread_local TraceBuffer* buffer = nullptr;
+  if (!buffer) {
+    lock_guard<mutex> lock(trace_buffers_mutex);
+    trace_buffers.emplace_back(new TraceBuffer{(int)trace_buffers.size(), {}});
+    buffer = trace_buffers.back().get();
+  }
+  return *buffer;
+}
+
+double trace_time_us(Clock::time_point t) {
+  return chrono::duration<double,micro>(t - trace_epoch).count();
+}
+
+void trace_event(const char* name, long arg, Clock::time_point start, Clock::time_point end) {
+  double start_us = trace_time_us(start);
+  thread_trace_buffer().events.push_back(TraceEvent{name, arg, start_us, trace_time_us(end) - start_us});
+}
+
+// Trace a scope that is not a phase
+struct ScopedTrace {
+  const char* name;
+  long arg;
+  Clock::time_point start;
+  
+  ScopedTrace(const char* name, long arg = -1) : name(name), arg(arg) {
+    if (collect_trace) start = Clock::now();
+  }
+  ~ScopedTrace() {
+    if (collect_trace) trace_event(name, arg, start, Clock::now());
+  }
+};
+
+void write_trace(FILE* out) {
+  lock_guard<mutex> lock(trace_buffers_mutex);
+  fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  bool first = true;
+  for (auto const& buffer : trace_buffers) {
+    string thread_name = buffer->tid ? "worker " + to_string(buffer->tid) : "main";
+    fprintf(out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+            first ? "" : ",", buffer->tid, thread_name.c_str());
+    first = false;
+    for (auto const& e : buffer->events) {
+      fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+              e.name, buffer->tid, e.start_us, e.duration_us);
+      if (e.arg >= 0) fprintf(out, ", \"args\": {\"node\": %ld}", e.arg);
+      fprintf(out, "}");
+    }
+  }
+  fprintf(out, "\n]}\n");
+}
+
+// Hardware performance counters, read around every phase (with --perf, only on Linux).
+// These count events in the main thread only.
+enum HardwareCounter {
+  HW_CYCLES,
+  HW_INSTRUCTIONS,
+  HW_LLC_MISSES,
+  HW_BRANCH_MISSES,
+  NUM_HARDWARE_COUNTERS
+};
+const char* hardware_counter_names[NUM_HARDWARE_COUNTERS] = {
+  "cycles", "instructions", "llc-misses", "branch-misses"
+};
+
+bool collect_hardware = false;
+int  hardware_fds[NUM_HARDWARE_COUNTERS] = {-1, -1, -1, -1};
+long long phase_hardware[NUM_PHASES][NUM_HARDWARE_COUNTERS];
+
+// Open the counters, returns false if the kernel doesn't allow it.
+// Counters that are not supported by the cpu are skipped.
+bool open_hardware_counters() {
+#ifdef __linux__
+  const uint64_t configs[NUM_HARDWARE_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+  };
+  bool any = false;
+  int error[NUM_HARDWARE_COUNTERS];
+  for (int c = 0; c < NUM_HARDWARE_COUNTERS; ++c) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[c];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    hardware_fds[c] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    error[c] = errno;
+    any |= hardware_fds[c] >= 0;
+  }
+  if (!any) {
+    fprintf(stderr, "warning: hardware counters are not available: %s\n", strerror(error[0]));
+    return false;
+  }
+  for (int c = 0; c < NUM_HARDWARE_COUNTERS; ++c) {
+    if (hardware_fds[c] < 0) {
+      fprintf(stderr, "warning: hardware counter %s is not available: %s\n", hardware_counter_names[c], strerror(error[c]));
+    }
+  }
+  return true;
+#else
+  fprintf(stderr, "warning: hardware counters are only supported on Linux\n");
+  return false;
+#endif
+}
+
+void read_hardware_counters(long long* values) {
+  for (int c = 0; c < NUM_HARDWARE_COUNTERS; ++c) {
+    values[c] = 0;
+#ifdef __linux__
+    if (hardware_fds[c] >= 0 && read(hardware_fds[c], &values[c], sizeof(values[c])) != sizeof(values[c])) {
+      values[c] = 0;
+    }
+#endif
+  }
+}
+
+// Add time spent in the current scope to a phase.
+// Time spent in timers nested in it is only added to their own phase, so the phases add up to the total time.
+struct ScopedTimer {
+  Phase phase;
+  long arg;
+  int outer_phase;
+  ScopedTimer* outer; // the timer this one is nested in
+  Clock::time_point start;
+  double child_seconds;
+  long start_rss_kb, child_rss_kb;
+  long long start_hardware[NUM_HARDWARE_COUNTERS], child_hardware[NUM_HARDWARE_COUNTERS];
+  
+  static thread_local ScopedTimer* innermost;
+  
+  ScopedTimer(Phase phase, long arg = -1) : phase(phase), arg(arg) {
+    if (collect_stats || collect_trace) start = Clock::now();
+    if (collect_stats) {
+      outer_phase = current_phase;
+      current_phase = phase;
+      outer = innermost;
+      innermost = this;
+      child_seconds = 0;
+      child_rss_kb = 0;
+      if (collect_memory) start_rss_kb = peak_rss_kb();
+      if (collect_hardware) {
+        read_hardware_counters(start_hardware);
+        for (int c = 0; c < NUM_HARDWARE_COUNTERS; ++c) child_hardware[c] = 0;
+      }
+    }
+  }
+  ~ScopedTimer() {
+    if (!collect_stats && !collect_trace) return;
+    Clock::time_point end = Clock::now();
+    if (collect_stats) {
+      if (collect_hardware) {
+        long long end_hardware[NUM_HARDWARE_COUNTERS];
+        read_hardware_counters(end_hardware);
+        for (int c = 0; c < NUM_HARDWARE_COUNTERS; ++c) {
+          long long used = end_hardware[c] - start_hardware[c];
+          phase_hardware[phase][c] += used - child_hardware[c];
+          if (outer) outer->child_hardware[c] += used;
+        }
+      }
+      double seconds = chrono::duration<double>(end - start).count();
+      phase_stats[phase].seconds += seconds - child_seconds;
+      phase_stats[phase].calls++;
+      if (outer) outer->child_seconds += seconds;
+      if (collect_memory) {
+        long growth = peak_rss_kb() - start_rss_kb;
+        phase_memory[phase].rss_growth_kb += growth - child_rss_kb;
+        if (outer) outer->child_rss_kb += growth;
+      }
+      innermost = outer;
+      current_phase = outer_phase;
+    }
+    if (collect_trace) trace_event(phase_names[phase], arg, start, end);
+  }
+};
+thread_local ScopedTimer* ScopedTimer::innermost = nullptr;
+
+// Start a worker thread, that charges its allocations to the phase of the thread that starts it
+template <typename F>
+thread phase_thread(F f) {
+  int phase = current_phase;
+  return thread([phase, f]() {
+    current_phase = phase;
+    f();
+  });
+}
+
+// Event counters, these are compiled in only with -DENABLE_COUNTERS
+#ifdef ENABLE_COUNTERS
+const bool COUNTERS = true;
+#else
+const bool COUNTERS = false;
+#endif
+
+enum Counter {
+  COUNT_HEAP_PUSH,
+  COUNT_HEAP_POP,
+  COUNT_HEAP_STALE_POP,
+  COUNT_BFS_EDGES,
+  COUNT_BUCKET_SCANS,
+  COUNT_TREE_CACHE_HITS,
+  COUNT_TREE_CACHE_MISSES,
+  COUNT_TREE_CACHE_EVICTIONS,
+  COUNT_MATCHING_NODES,
+  COUNT_MATCHING_EDGES,
+  COUNT_FLOW_AUGMENTATIONS,
+  COUNT_EDGE_SEARCHES,
+  COUNT_EDGE_SEARCH_STEPS,
+  COUNT_BRUTE_FORCE_NODES,
+  COUNT_SENSITIVITY_SOLVES,
+  COUNT_SENSITIVITY_TREES,
+  NUM_COUNTERS
+};
+const char* counter_names[NUM_COUNTERS] = {
+  "heap-push", "heap-pop", "heap-stale-pop", "bfs-edges", "bucket-scans", "tree-cache-hits", "tree-cache-misses",
+  "tree-cache-evictions", "matching-nodes", "matching-edges", "flow-augmentations",
+  "edge-searches", "edge-search-steps", "brute-force-nodes", "sensitivity-solves", "sensitivity-trees"
+};
+
+long counters[NUM_COUNTERS];
+
+inline void count(Counter counter, long n = 1) {
+  if (COUNTERS) counters[counter] += n;
+}
+
+void print_memory_table(FILE* out);
+void print_memory_json_members(FILE* out, const char* indent);
+
+void print_stats_table(FILE* out) {
+  if (collect_stats) {
+    fprintf(out, "%-16s %12s %10s %12s\n", "phase", "total (ms)", "calls", "mean (us)");
+    for (int p = 0; p < NUM_PHASES; ++p) {
+      PhaseStats const& s = phase_stats[p];
+      if (s.calls == 0) continue;
+      fprintf(out, "%-16s %12.3f %10ld %12.3f\n", phase_names[p], s.seconds * 1e3, s.calls, s.seconds * 1e6 / s.calls);
+    }
+  }
+  if (COUNTERS) {
+    fprintf(out, "%-20s %12s\n", "counter", "count");
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+      fprintf(out, "%-20s %12ld\n", counter_names[c], counters[c]);
+    }
+  }
+  if (collect_memory) {
+    print_memory_table(out);
+  }
+  if (collect_hardware) {
+    fprintf(out, "%-16s %14s %14s %6s %12s %14s\n", "phase", "cycles", "instructions", "IPC", "llc-misses", "branch-misses");
+    for (int p = 0; p < NUM_PHASES; ++p) {
+      if (phase_stats[p].calls == 0) continue;
+      long long const* hw = phase_hardware[p];
+      double ipc = hw[HW_CYCLES] ? (double)hw[HW_INSTRUCTIONS] / hw[HW_CYCLES] : 0;
+      fprintf(out, "%-16s %14lld %14lld %6.2f %12lld %14lld\n", phase_names[p],
+              hw[HW_CYCLES], hw[HW_INSTRUCTIONS], ipc, hw[HW_LLC_MISSES], hw[HW_BRANCH_MISSES]);
+    }
+  }
+}
+
+// Write the statistics as members of a JSON object
+void print_stats_json_members(FILE* out, const char* indent) {
+  fprintf(out, "%s\"phases\": {", indent);
+  bool first = true;
+  for (int p = 0; p < NUM_PHASES; ++p) {
+    PhaseStats const& s = phase_stats[p];
+    if (s.calls == 0) continue;
+    fprintf(out, "%s\n%s  \"%s\": {\"seconds\": %.9f, \"calls\": %ld}", first ? "" : ",", indent, phase_names[p], s.seconds, s.calls);
+    first = false;
+  }
+  fprintf(out, "\n%s}", indent);
+  if (COUNTERS) {
+    fprintf(out, ",\n%s\"counters\": {", indent);
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+      fprintf(out, "%s\n%s  \"%s\": %ld", c == 0 ? "" : ",", indent, counter_names[c], counters[c]);
+    }
+    fprintf(out, "\n%s}", indent);
+  }
+  if (collect_memory) {
+    fprintf(out, ",\n");
+    print_memory_json_members(out, indent);
+  }
+  if (collect_hardware) {
+    fprintf(out, ",\n%s\"hardware\": {", indent);
+    first = true;
+    for (int p = 0; p < NUM_PHASES; ++p) {
+      if (phase_stats[p].calls == 0) continue;
+      fprintf(out, "%s\n%s  \"%s\": {", first ? "" : ",", indent, phase_names[p]);
+      for (int c = 0; c < NUM_HARDWARE_COUNTERS; ++c) {
+        fprintf(out, "%s\"%s\": %lld", c ? ", " : "", hardware_counter_names[c], phase_hardware[p][c]);
+      }
+      fprintf(out, "}");
+      first = false;
+    }
+    fprintf(out, "\n%s}", indent);
+  }
+}
+
+void print_stats_json(FILE* out) {
+  fprintf(out, "{\n");
+  print_stats_json_members(out, "  ");
+  fprintf(out, "\n}\n");
+}
+
+// -----------------------------------------------------------------------------
+// Memory accounting
+// -----------------------------------------------------------------------------
+
+// Count all allocations, per phase.
+// The default operator delete calls free, so it doesn't have to be replaced.
+void* operator new(size_t size) {
+  if (collect_memory) {
+    phase_memory[current_phase].allocations.fetch_add(1, memory_order_relaxed);
+    phase_memory[current_phase].bytes.fetch_add((long)size, memory_order_relaxed);
+  }
+  void* p = malloc(size ? size : 1);
+  if (!p) throw bad_alloc();
+  return p;
+}
+
+// Memory used by each subsystem
+enum Subsystem {
+  MEM_GRAPH,
+  MEM_DISTANCES,
+  MEM_MATCHING,
+  MEM_BRUTE_FORCE,
+  NUM_SUBSYSTEMS
+};
+const char* subsystem_names[NUM_SUBSYSTEMS] = {
+  "graph", "distance-caches", "matching", "brute-force-stack"
+};
+
+struct SubsystemMemory {
+  long bytes;       // currently in use
+  long peak_bytes;
+  long allocations;
+};
+SubsystemMemory subsystem_memory[NUM_SUBSYSTEMS];
+
+void track_memory(Subsystem subsystem, long bytes, long allocations = 1) {
+  SubsystemMemory& m = subsystem_memory[subsystem];
+  m.bytes += bytes;
+  m.peak_bytes = max(m.peak_bytes, m.bytes);
+  m.allocations += allocations;
+}
+
+// Allocator for our own containers, that keeps track of how much memory each subsystem uses
+template <typename T, Subsystem S>
+struct CountingAllocator {
+  typedef T value_type;
+  template <typename U> struct rebind { typedef CountingAllocator<U,S> other; };
+  
+  CountingAllocator() {}
+  template <typename U> CountingAllocator(CountingAllocator<U,S> const&) {}
+  
+  T* allocate(size_t n) {
+    if (collect_memory) track_memory(S, (long)(n * sizeof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t n) {
+    if (collect_memory) track_memory(S, -(long)(n * sizeof(T)), 0);
+    ::operator delete(p);
+  }
+};
+template <typename T, typename U, Subsystem S>
+bool operator == (CountingAllocator<T,S> const&, CountingAllocator<U,S> const&) { return true; }
+template <typename T, typename U, Subsystem S>
+bool operator != (CountingAllocator<T,S> const&, CountingAllocator<U,S> const&) { return false; }
+
+// The matching library uses malloc directly, so we can only find its memory use by asking malloc
+long heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  return (long)mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// Warn when the distance caches are projected to grow beyond this many bytes (0 for no limit)
+long distance_cache_limit = 0;
+bool distance_cache_warned = false;
+int  distance_cache_sources = 0;
+// Keep at most this many bytes of shortest path trees (0 for no limit), see PathTreeCache
+size_t path_tree_cache_budget = 0;
+
+void check_distance_cache_limit(size_t num_nodes) {
+  // a bounded cache doesn't grow with the number of sources
+  if (!collect_memory || !distance_cache_limit || distance_cache_warned || path_tree_cache_budget) return;
+  double projected = (double)subsystem_memory[MEM_DISTANCES].bytes / distance_cache_sources * num_nodes;
+  if (projected > distance_cache_limit) {
+    fprintf(stderr, "warning: distance caches are projected to use %.1f MB (%d of %d sources done), more than the limit of %.1f MB\n",
+            projected / 1048576, distance_cache_sources, (int)num_nodes, distance_cache_limit / 1048576.0);
+    distance_cache_warned = true;
+  }
+}
+
+// Stack use of the brute force search
+char* brute_force_stack_base = nullptr;
+
+void track_stack(char* top) {
+  long used = (long)(brute_force_stack_base - top);
+  SubsystemMemory& m = subsystem_memory[MEM_BRUTE_FORCE];
+  m.peak_bytes = max(m.peak_bytes, used);
+}
+
+void print_memory_table(FILE* out) {
+  fprintf(out, "%-18s %12s %12s %12s\n", "subsystem", "current (KB)", "peak (KB)", "allocations");
+  for (int s = 0; s < NUM_SUBSYSTEMS; ++s) {
+    SubsystemMemory const& m = subsystem_memory[s];
+    fprintf(out, "%-18s %12.1f %12.1f %12ld\n", subsystem_names[s], m.bytes / 1024.0, m.peak_bytes / 1024.0, m.allocations);
+  }
+  fprintf(out, "%-16s %12s %12s %14s\n", "phase", "allocations", "alloc (KB)", "RSS growth (KB)");
+  for (int p = 0; p <= NUM_PHASES; ++p) {
+    PhaseMemory const& m = phase_memory[p];
+    if (m.allocations == 0 && m.rss_growth_kb == 0) continue;
+    fprintf(out, "%-16s %12ld %12.1f %14ld\n", p < NUM_PHASES ? phase_names[p] : "other", m.allocations.load(), m.bytes / 1024.0, m.rss_growth_kb);
+  }
+  fprintf(out, "peak RSS: %.1f MB\n", peak_rss_kb() / 1024.0);
+}
+
+void print_memory_json_members(FILE* out, const char* indent) {
+  fprintf(out, "%s\"memory\": {\"peak_rss_kb\": %ld, \"subsystems\": {", indent, peak_rss_kb());
+  for (int s = 0; s < NUM_SUBSYSTEMS; ++s) {
+    SubsystemMemory const& m = subsystem_memory[s];
+    fprintf(out, "%s\n%s  \"%s\": {\"bytes\": %ld, \"peak_bytes\": %ld, \"allocations\": %ld}",
+            s ? "," : "", indent, subsystem_names[s], m.bytes, m.peak_bytes, m.allocations);
+  }
+  fprintf(out, "\n%s}, \"phases\": {", indent);
+  bool first = true;
+  for (int p = 0; p <= NUM_PHASES; ++p) {
+    PhaseMemory const& m = phase_memory[p];
+    if (m.allocations == 0 && m.rss_growth_kb == 0) continue;
+    fprintf(out, "%s\n%s  \"%s\": {\"allocations\": %ld, \"bytes\": %ld, \"rss_growth_kb\": %ld}",
+            first ? "" : ",", indent, p < NUM_PHASES ? phase_names[p] : "other", m.allocations.load(), m.bytes.load(), m.rss_growth_kb);
+    first = false;
+  }
+  fprintf(out, "\n%s}}", indent);
+}
+
+// -----------------------------------------------------------------------------
+// Graph
+// -----------------------------------------------------------------------------
 
 // steps in an (acyclic/shortest) path
+template <typename Cost>
 struct Path {
   int  prev; // previous node on shortest path
   Cost cost; // total path length
 };
 
-struct Edge {
+template <typename Cost>
+using Paths = map<int,Path<Cost>,less<int>,CountingAllocator<pair<const int,Path<Cost>>,MEM_DISTANCES>>;
+
+// Shortest paths from one source, stored compactly as a vector sorted by node.
+// This is how shortest paths are cached, the Paths map is only used while they are found.
+template <typename Cost>
+struct PathTree {
+  struct Step {
+    int  node;
+    int  prev; // previous node on shortest path, -1 for the source
+    Cost cost; // total path length
+  };
+  vector<Step,CountingAllocator<Step,MEM_DISTANCES>> steps;
+  
+  PathTree() {}
+  explicit PathTree(Paths<Cost> const& paths) {
+    steps.reserve(paths.size());
+    for (auto const& p : paths) steps.push_back(Step{p.first, p.second.prev, p.second.cost});
+  }
+  // the step to node j, or nullptr if j is not reachable
+  Step const* find(int j) const {
+    auto it = lower_bound(steps.begin(), steps.end(), j, [](Step const& s, int j) { return s.node < j; });
+    return it != steps.end() && it->node == j ? &*it : nullptr;
+  }
+  size_t bytes() const {
+    return sizeof(*this) + steps.capacity() * sizeof(Step);
+  }
+};
+
+// Edge weight policies.
+// These determine how the cost of an edge from node i to node j is found, and are passed as template arguments,
+// so that the cost computation is inlined into the algorithms.
+// Implicit costs (that only depend on i and j) are not stored at all.
+enum WeightPolicy {WEIGHTS_EXPLICIT, WEIGHTS_PORT_SUM, WEIGHTS_UNIT};
+const char* weight_policy_names[] = {"explicit", "port-sum", "unit"};
+
+// Cost given in the input, stored with each edge
+template <typename C>
+struct ExplicitWeights {
+  typedef C Cost;
+  static const WeightPolicy policy = WEIGHTS_EXPLICIT;
+  Cost stored_cost;
+  ExplicitWeights(Cost cost) : stored_cost(cost) {}
+  Cost edge_cost(int, int) const { return stored_cost; }
+};
+
+// Cost is the sum of the port numbers i+j, as in the AoC problem.
+// With the Lex cost type this is the lexicographic cost of problem 2.
+template <typename C>
+struct PortSumWeights {
+  typedef C Cost;
+  static const WeightPolicy policy = WEIGHTS_PORT_SUM;
+  PortSumWeights(Cost) {}
+  Cost edge_cost(int i, int j) const { return edge_cost_as<Cost>((int64_t)i + j); }
+};
+
+// All edges have the same cost, unit_edge_cost (usually 1), so shortest paths can be found with BFS
+int64_t unit_edge_cost = 1;
+
+template <typename C>
+struct UnitWeights {
+  typedef C Cost;
+  static const WeightPolicy policy = WEIGHTS_UNIT;
+  UnitWeights(Cost) {}
+  Cost edge_cost(int, int) const { return edge_cost_as<Cost>(unit_edge_cost); }
+};
+
+// The weight policy is a base class, so it takes no space if it has no members
+template <typename Weights>
+struct Edge : Weights {
+  typedef typename Weights::Cost Cost;
   int  to;
-  Cost cost;
-  mutable bool marked;
+  int  rev; // index of the same edge in the edges of node 'to', or -1 for an arc of a directed graph
+  mutable uint16_t marked; // number of copies that are used (brute force) or removed
+  uint16_t capacity;       // number of copies of this edge, they fit in the padding after marked
+  
+  Edge(Cost cost, int to, int rev, int capacity = 1) : Weights(cost), to(to), rev(rev), marked(0), capacity((uint16_t)capacity) {}
+  // cost of this edge, when coming from node 'from'
+  Cost cost(int from) const { return Weights::edge_cost(from, to); }
 };
 
 // Graph
+template <typename Weights>
 struct Node {
-  vector<Edge> edges;
+  typedef typename Weights::Cost Cost;
+  vector<Edge<Weights>,CountingAllocator<Edge<Weights>,MEM_GRAPH>> edges;
   
   // for algorithms:
   mutable int id;              // lookup this node in some table
-  mutable map<int,Path> dists; // shortest paths from this node
   
-  Edge const& find_unmarked_edge_to(int j) const {
+  // number of edges, counting every copy
+  int degree() const {
+    int degree = 0;
+    for (auto const& e : edges) degree += e.capacity;
+    return degree;
+  }
+  
+  // the cheapest of the (possibly parallel) edges to j that still have an unmarked copy, where i is this node
+  Edge<Weights> const& find_unmarked_edge_to(int i, int j) const {
+    count(COUNT_EDGE_SEARCHES);
+    Edge<Weights> const* best = nullptr;
     for (auto const& e : edges) {
-      if (e.to == j && !e.marked) return e;
+      count(COUNT_EDGE_SEARCH_STEPS);
+      if (e.to == j && e.marked < e.capacity && (!best || e.cost(i) < best->cost(i))) best = &e;
     }
-    throw "No unmarked edge";
+    if (!best) throw "No unmarked edge";
+    return *best;
   }
 };
 
+template <typename Weights>
+using Graph = map<int,Node<Weights>,less<int>,CountingAllocator<pair<const int,Node<Weights>>,MEM_GRAPH>>;
+
+// In a directed graph (--directed) an edge i/j of the input is an arc from i to j, that is only stored at node i
+bool directed = false;
+
 // -----------------------------------------------------------------------------
 // Brute force solution
 // -----------------------------------------------------------------------------
 
-void longest_paths_brute(map<int,Node> const& graph, map<int,Cost>& dist, int i, int cost) {
+template <typename Weights, typename Cost = typename Weights::Cost>
+void longest_paths_brute(Graph<Weights> const& graph, map<int,Cost>& dist, int i, Cost cost) {
+  count(COUNT_BRUTE_FORCE_NODES);
+  if (collect_memory) {
+    char top;
+    track_stack(&top);
+  }
   if (dist[i] < cost) dist[i] = cost;
-  Node const& node_i = graph.at(i);
-  for (auto const& edge_j : node_i.edges) {
-    if (!edge_j.marked) {
+  Node<Weights> const& node_i = graph.at(i);
+  for (size_t k = 0; k < node_i.edges.size(); ++k) {
+    auto const& edge_j = node_i.edges[k];
+    // an undirected self loop is the same in both directions, so only follow its first half
+    if (edge_j.to == i && edge_j.rev >= 0 && edge_j.rev < (int)k) continue;
+    // marked counts the copies of the edge that are used
+    if (edge_j.marked < edge_j.capacity) {
       int j = edge_j.to;
-      edge_j.marked = true;
-      auto const& edge_i = graph.at(j).find_unmarked_edge_to(i);
-        // Note: we have to mark edge_i first, because if i==j we want to mark both endpoints, not the same endpoint twice
-      edge_i.marked = true;
-      longest_paths_brute(graph, dist, j, cost + edge_j.cost);
-      edge_i.marked = false;
-      edge_j.marked = false;
+      edge_j.marked++;
+      LOG(LOG_BRUTE, LOG_TRACE, "%d - %d: %s", i, j, cost_to_string(cost + edge_j.cost(i)).c_str());
+      // Note: use the reverse of this same edge, with parallel edges or self loops any other unmarked edge to i might have a different cost
+      Edge<Weights> const* edge_i = edge_j.rev >= 0 ? &graph.at(j).edges[edge_j.rev] : nullptr;
+      if (edge_i) edge_i->marked++;
+      longest_paths_brute(graph, dist, j, cost + edge_j.cost(i));
+      if (edge_i) edge_i->marked--;
+      edge_j.marked--;
     }
   }
 }
 
 // Find longest paths to each node, starting from i0
-map<int,Cost> longest_paths_brute(map<int,Node> const& graph, int i0) {
+template <typename Weights, typename Cost = typename Weights::Cost>
+map<int,Cost> longest_paths_brute(Graph<Weights> const& graph, int i0) {
+  ScopedTimer timer(PHASE_BRUTE_FORCE);
   map<int,Cost> dist;
   // we will mark edges that have been used
   for (auto& node : graph) {
     for (auto const& e : node.second.edges) {
-      e.marked = false;
+      e.marked = 0;
     }
   }
-  longest_paths_brute(graph, dist, i0, 0);
+  char stack_base;
+  brute_force_stack_base = &stack_base;
+  longest_paths_brute(graph, dist, i0, Cost(0));
+  LOG(LOG_BRUTE, LOG_INFO, "brute force from %d: %d nodes reachable", i0, (int)dist.size());
   return dist;
 }
 
+// Shortest closed walk from i0 that uses every edge of its component, by trying every set of edges to walk twice.
+// Walking an edge more than twice never helps.
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost postman_brute(Graph<Weights> const& graph, int i0) {
+  ScopedTimer timer(PHASE_BRUTE_FORCE);
+  struct BruteEdge { int i, j; Cost cost; int capacity; };
+  vector<BruteEdge> edges;
+  Cost total(0);
+  set<int> seen;
+  vector<int> queue = {i0};
+  while (!queue.empty()) {
+    int i = queue.back(); queue.pop_back();
+    if (!seen.insert(i).second) continue;
+    auto const& edges_i = graph.at(i).edges;
+    for (size_t k = 0; k < edges_i.size(); ++k) {
+      auto const& e = edges_i[k];
+      queue.push_back(e.to);
+      // every edge once, from its lowest end (a self loop from its first half)
+      if (e.to < i || (e.to == i && e.rev < (int)k)) continue;
+      // walking one copy of an edge again is enough, but all copies have to be walked once
+      edges.push_back(BruteEdge{i, e.to, e.cost(i), e.capacity});
+      total += cost_times(e.cost(i), e.capacity);
+    }
+  }
+  if (edges.size() > 24) throw "Too many edges for the brute force postman";
+  // parity of the nodes as bits, walking an edge again flips both ends
+  vector<int> nodes(seen.begin(), seen.end());
+  auto bit = [&](int i) { return 1u << (lower_bound(nodes.begin(), nodes.end(), i) - nodes.begin()); };
+  uint32_t odd = 0;
+  for (auto const& e : edges) {
+    if (e.capacity % 2) odd ^= bit(e.i) ^ bit(e.j);
+  }
+  Cost best(0);
+  bool found = false;
+  for (uint32_t twice = 0; twice < (1u << edges.size()); ++twice) {
+    count(COUNT_BRUTE_FORCE_NODES);
+    uint32_t parity = odd;
+    Cost cost(0);
+    for (size_t k = 0; k < edges.size(); ++k) {
+      if (!(twice >> k & 1)) continue;
+      parity ^= bit(edges[k].i) ^ bit(edges[k].j);
+      cost += edges[k].cost;
+    }
+    if (parity == 0 && (!found || cost < best)) {
+      best = cost;
+      found = true;
+    }
+  }
+  LOG(LOG_BRUTE, LOG_INFO, "brute force postman from %d: %d edges, cost %s", i0, (int)edges.size(), cost_to_string(total + best).c_str());
+  return total + best;
+}
+
 // -----------------------------------------------------------------------------
 // Efficient solution
 // -----------------------------------------------------------------------------
 
-// Find the shortest paths in a graph, leaving from node i0
-map<int,Path> shortest_paths(map<int,Node> const& graph, int i0) {
-  map<int,Path> paths;
+// Algorithm for single source shortest paths, set with --sssp
+// floyd only applies to the distances between all nodes, single sources use Dijkstra
+// ch uses a contraction hierarchy for the distances between exposed nodes, instead of distances from all nodes
+enum ShortestPathAlgorithm {SSSP_AUTO, SSSP_DIJKSTRA, SSSP_BFS, SSSP_BUCKETS, SSSP_FLOYD, SSSP_CH, SSSP_DELTA};
+const char* shortest_path_algorithm_names[] = {"auto", "dijkstra", "bfs", "buckets", "floyd", "ch", "delta"};
+ShortestPathAlgorithm shortest_path_algorithm = SSSP_AUTO;
+
+// Number of threads for parallel shortest paths (delta-stepping), set with --threads
+int num_threads = 1;
+// Use delta-stepping automatically for graphs with at least this many nodes, if there is more than one thread
+const size_t MIN_AUTO_DELTA_NODES = 100000;
+size_t graph_size = 0;
+
+// Delta-stepping can't stop all threads when a checked cost overflows
+template <typename Cost>
+using DeltaSteppingCost = integral_constant<bool, CostTraits<Cost>::type != COST_CHECKED32 && CostTraits<Cost>::type != COST_CHECKED64>;
+
+// Range of the edge costs in the graph, buckets are used automatically if the costs are small enough
+int64_t min_edge_cost = 0, max_edge_cost = 0;
+const int64_t MAX_AUTO_BUCKETS = 1024;
+const int64_t MAX_BUCKETS = 1 << 24;
+
+// Find the shortest paths in a graph, leaving from node i0, with Dijkstra's algorithm
+template <typename Weights, typename Cost = typename Weights::Cost>
+Paths<Cost> shortest_paths(Graph<Weights> const& graph, int i0) {
+  ScopedTimer timer(PHASE_SHORTEST_PATHS, i0);
+  Paths<Cost> paths;
   priority_queue<pair<Cost,pair<int,int>>> pq;
-  pq.push(make_pair(0,make_pair(-1,i0)));
+  pq.push(make_pair(Cost(0),make_pair(-1,i0)));
+  count(COUNT_HEAP_PUSH);
   while (!pq.empty()) {
     Cost d    = -pq.top().first;
     int  prev = pq.top().second.first;
     int  i    = pq.top().second.second;
     pq.pop();
+    count(COUNT_HEAP_POP);
     auto paths_i = paths.find(i);
     if (paths_i == paths.end() || d < paths_i->second.cost) {
       // follow edges
-      paths[i] = Path{prev,d};
+      paths[i] = Path<Cost>{prev,d};
       for (auto const& j : graph.at(i).edges) {
-        pq.push(make_pair(-(d + j.cost), make_pair(i,j.to)));
+        pq.push(make_pair(-(d + j.cost(i)), make_pair(i,j.to)));
+        count(COUNT_HEAP_PUSH);
       }
+    } else {
+      count(COUNT_HEAP_STALE_POP);
     }
   }
+  LOG(LOG_DIJKSTRA, LOG_DEBUG, "shortest paths from %d: %d nodes reachable", i0, (int)paths.size());
   return paths;
 }
 
-void mark_half_edge(map<int,Node> const& graph, int i, int j) {
-  Node const& node_j = graph.at(j);
-  node_j.find_unmarked_edge_to(i).marked = true;
+// mark the cheapest edge from i to j, the shortest path used that one
+template <typename Weights>
+void mark_edge(Graph<Weights> const& graph, int i, int j) {
+  LOG(LOG_MARKING, LOG_TRACE, "mark %d - %d", i, j);
+  Edge<Weights> const& e = graph.at(i).find_unmarked_edge_to(i, j);
+  e.marked++;
+  if (e.rev >= 0) graph.at(j).edges[e.rev].marked++;
 }
-void mark_edge(map<int,Node> const& graph, int i, int j) {
-  if (VERBOSE) printf("    mark %d - %d\n", i, j);
-  mark_half_edge(graph, i, j);
-  mark_half_edge(graph, j, i);
+// mark the edges between consecutive nodes of a path
+template <typename Weights>
+void mark_path(Graph<Weights> const& graph, vector<int> const& path) {
+  for (size_t k = 1; k < path.size(); ++k) {
+    mark_edge(graph, path[k-1], path[k]);
+  }
 }
-void mark_path(map<int,Node> const& graph, map<int,Path> dists, int j) {
-  while (dists[j].prev >= 0) {
-    mark_edge(graph, dists[j].prev, j);
-    j = dists[j].prev;
+// Nodes on the shortest path to j, from j back to the source, are appended to out.
+// Nothing is appended if j is not reachable.
+template <typename Cost>
+void trace_path(PathTree<Cost> const& tree, int j, vector<int>& out) {
+  for (auto s = tree.find(j); s; s = tree.find(s->prev)) {
+    out.push_back(s->node);
   }
 }
-void print_path(map<int,Path> dists, int j) {
-  while (j >= 0) {
-    printf(" (%d) %d", dists[j].cost, j);
-    j = dists[j].prev;
+template <typename Cost>
+string path_to_string(PathTree<Cost> const& tree, int j) {
+  string out;
+  for (auto s = tree.find(j); s; s = tree.find(s->prev)) {
+    out += " (" + cost_to_string(s->cost) + ") " + to_string(s->node);
   }
+  return out;
 }
 
-int longest_path_to(map<int,Node> const& graph, int i0, int i1) {
-  // Is there even a path from i0 to i1?
-  auto const& node_i0 = graph.at(i0);
-  if (node_i0.dists.empty()) {
-    node_i0.dists = shortest_paths(graph, i0);
-  }
-  if (node_i0.dists.find(i1) == node_i0.dists.end()) {
-    return -1;
-  }
-  
-  // Find exposed nodes, and mapping to ids
-  // A node is exposed if it has odd degree, counting an extra edge from i0 to i1  (if i0==i1 both end points count)
-  // Each exposed node needs one if its incident edges removed.
-  for (const auto& node : graph) {
-    node.second.id = -1; // not exposed
-  }
-  struct Exposed {};
-  vector<int> exposed;
-  for (auto const& node : graph) {
-    int i = node.first;
-    int degree = (int)node.second.edges.size();
-    if (i == i0) degree++;
-    if (i == i1) degree++;
-    if (degree % 2 == 1) {
-      node.second.id = (int)exposed.size();
-      exposed.push_back(i);
-      if (VERBOSE) printf("exposed: %d -> [%d]  (degree: %d)\n", i, node.second.id, degree);
-    }
-    // calculate shortest paths
-    if (node.second.dists.empty()) {
-      node.second.dists = shortest_paths(graph, i);
+// Breadth first search, this finds shortest paths if all edges have the same cost
+template <typename Weights, typename Cost = typename Weights::Cost>
+Paths<Cost> shortest_paths_bfs(Graph<Weights> const& graph, int i0) {
+  ScopedTimer timer(PHASE_SHORTEST_PATHS, i0);
+  Paths<Cost> paths;
+  paths[i0] = Path<Cost>{-1,Cost(0)};
+  vector<int> frontier, next;
+  frontier.push_back(i0);
+  while (!frontier.empty()) {
+    for (int i : frontier) {
+      Cost d = paths[i].cost;
+      for (auto const& j : graph.at(i).edges) {
+        count(COUNT_BFS_EDGES);
+        if (paths.insert(make_pair(j.to, Path<Cost>{i, d + j.cost(i)})).second) {
+          next.push_back(j.to);
+        }
+      }
     }
+    frontier.swap(next);
+    next.clear();
   }
-  
-  // set up PerfectMatching, using shortest paths between exposed nodes as weights
-  PerfectMatching matching((int)exposed.size(), (int)(exposed.size()*(exposed.size()-1)));
-  matching.options.verbose = false;
-  for (auto i : exposed) {
-    Node const& node_i = graph.at(i);
-    for (auto j : exposed) {
-      if (i < j) {
-        auto p = node_i.dists.find(j);
-        if (p != node_i.dists.end()) {
-          Node const& node_j = graph.at(j);
-          matching.AddEdge(node_i.id, node_j.id, p->second.cost);
-          if (VERBOSE) {
-            printf("  [%d] - [%d] = %d  (path: ", node_i.id, node_j.id, p->second.cost);
-            print_path(node_i.dists, j);
-            printf(")\n");
-          }
-        }
+  LOG(LOG_DIJKSTRA, LOG_DEBUG, "bfs from %d: %d nodes reachable", i0, (int)paths.size());
+  return paths;
+}
+
+// Dial's algorithm: Dijkstra with buckets instead of a heap, for small integer costs.
+// All nodes in the queue have a distance between d and d+max_edge_cost,
+// so a circular array of max_edge_cost+1 buckets can hold them, and bucket b holds distance d+b.
+template <typename Weights, typename Cost = typename Weights::Cost>
+Paths<Cost> shortest_paths_buckets(Graph<Weights> const& graph, int i0) {
+  ScopedTimer timer(PHASE_SHORTEST_PATHS, i0);
+  Paths<Cost> paths;
+  size_t num_buckets = (size_t)max_edge_cost + 1;
+  vector<vector<pair<int,int>>> buckets(num_buckets); // (prev, node)
+  buckets[0].push_back(make_pair(-1,i0));
+  count(COUNT_HEAP_PUSH);
+  size_t queued = 1;
+  Cost d(0);
+  for (size_t b = 0; queued > 0; b = b + 1 == num_buckets ? 0 : b + 1, d += Cost(1)) {
+    count(COUNT_BUCKET_SCANS);
+    auto& bucket = buckets[b];
+    // edges with cost 0 add to this same bucket
+    for (size_t k = 0; k < bucket.size(); ++k) {
+      int prev = bucket[k].first;
+      int i    = bucket[k].second;
+      queued--;
+      count(COUNT_HEAP_POP);
+      if (!paths.insert(make_pair(i, Path<Cost>{prev,d})).second) {
+        count(COUNT_HEAP_STALE_POP);
+        continue;
+      }
+      for (auto const& j : graph.at(i).edges) {
+        size_t c = (size_t)cost_to_double(j.cost(i));
+        buckets[(b + c) % num_buckets].push_back(make_pair(i,j.to));
+        queued++;
+        count(COUNT_HEAP_PUSH);
       }
     }
+    bucket.clear();
   }
-  
-  // Solve perfect matching
-  matching.Solve(true);
+  LOG(LOG_DIJKSTRA, LOG_DEBUG, "shortest paths from %d: %d nodes reachable", i0, (int)paths.size());
+  return paths;
+}
 
-  if (VERBOSE) {
-    for (int id = 0; id < (int)exposed.size() ; ++id) {
-      printf("  match: [%d] - [%d]\n", id, matching.GetMatch(id));
+// Threads wait for each other at a barrier
+class Barrier {
+ public:
+  explicit Barrier(int n) : n(n), waiting(0), generation(0) {}
+  void wait() {
+    unique_lock<mutex> lock(m);
+    int gen = generation;
+    if (++waiting == n) {
+      waiting = 0;
+      generation++;
+      cv.notify_all();
+    } else {
+      cv.wait(lock, [&]{ return gen != generation; });
     }
   }
-  
-  // Mark all removed edges
+ private:
+  mutex m;
+  condition_variable cv;
+  int n, waiting, generation;
+};
+
+// The graph with nodes numbered densely and all edges in one array, for the parallel algorithms and the min cost flow
+template <typename Cost>
+struct CompactGraph {
+  vector<int>  keys;  // node of the graph for each number, sorted
+  vector<int>  start; // edges of node v are start[v]..start[v+1]
+  vector<int>  to;
+  vector<Cost> cost;
+  double average_cost = 0;
+};
+
+// The graph doesn't change once it is built, so the compact version is only made once
+template <typename Weights, typename Cost = typename Weights::Cost>
+CompactGraph<Cost> const& compact_graph(Graph<Weights> const& graph) {
+  static Graph<Weights> const* cached_graph = nullptr;
+  static CompactGraph<Cost> g;
+  if (cached_graph == &graph) return g;
+  cached_graph = &graph;
+  g = CompactGraph<Cost>();
+  for (auto const& node : graph) g.keys.push_back(node.first);
+  double total_cost = 0;
   for (auto const& node : graph) {
+    g.start.push_back((int)g.to.size());
     for (auto const& e : node.second.edges) {
-      e.marked = false;
+      g.to.push_back((int)(lower_bound(g.keys.begin(), g.keys.end(), e.to) - g.keys.begin()));
+      g.cost.push_back(e.cost(node.first));
+      total_cost += cost_to_double(g.cost.back());
     }
   }
-  for (int id = 0; id < (int)exposed.size() ; ++id) {
-    int i = exposed[id];
-    int j = exposed[matching.GetMatch(id)];
-    if (j < i) continue;
-    // mark the path from i to j
-    auto const& node_i = graph.at(i);
-    mark_path(graph, node_i.dists, j);
-  }
-
-  // Find connected component using only unmarked edges.
-  // Each node will have even degree, so there will exist an Euler path that uses all remaining edges.
-  // So just count weight of the remaining edges.
-  Cost total_cost = 0;
-  vector<int> queue;
-  set<int> seen;
-  queue.push_back(0);
+  g.start.push_back((int)g.to.size());
+  g.average_cost = g.to.empty() ? 1 : total_cost / g.to.size();
+  return g;
+}
+
+// Delta-stepping: nodes are kept in buckets of width delta by their tentative distance,
+// and all nodes in the lowest bucket are relaxed in parallel.
+// Edges shorter than delta ("light") can put nodes back in the current bucket, so these are relaxed until the bucket stays empty,
+// edges that are longer ("heavy") only once afterwards.
+// Each node is owned by one thread, which keeps its distance and buckets. Other threads send relaxation requests to the owner,
+// so that threads only have to synchronize at barriers.
+double delta_step = 0; // bucket width, 0 for the average edge cost
+
+template <typename Weights, typename Cost = typename Weights::Cost>
+Paths<Cost> shortest_paths_delta(Graph<Weights> const& graph, int i0) {
+  ScopedTimer timer(PHASE_SHORTEST_PATHS, i0);
+  CompactGraph<Cost> const& g = compact_graph(graph);
+  size_t n = g.keys.size();
+  int num_workers = max(1, num_threads);
+  double delta = delta_step > 0 ? delta_step : g.average_cost;
+  if (!(delta > 0)) delta = 1;
+  auto bucket_of = [delta](Cost d) { return (size_t)(cost_to_double(d) / delta); };
+  
+  const size_t NO_BUCKET = numeric_limits<size_t>::max();
+  vector<Cost>   dist(n);
+  vector<int>    pred(n, -2);          // -2 for nodes that are not reached yet
+  vector<size_t> in_bucket(n, NO_BUCKET); // bucket that a node was last put in, older entries are stale
+  struct Request {
+    int  node, pred;
+    Cost dist;
+  };
+  vector<vector<vector<Request>>> requests(num_workers, vector<vector<Request>>(num_workers)); // [from][owner]
+  vector<vector<vector<int>>> buckets(num_workers);
+  vector<char>   more(num_workers);
+  vector<size_t> next_bucket(num_workers);
+  Barrier barrier(num_workers);
+  
+  int s = (int)(lower_bound(g.keys.begin(), g.keys.end(), i0) - g.keys.begin());
+  dist[s] = Cost(0);
+  pred[s] = -1;
+  in_bucket[s] = 0;
+  buckets[s % num_workers].push_back(vector<int>(1, s));
+  
+  auto worker = [&](int t) {
+    ScopedTrace trace("delta-stepping", i0);
+    auto& my_buckets = buckets[t];
+    vector<int> current, settled;
+    size_t b = 0;
+    auto send = [&](int v, bool light) {
+      for (int k = g.start[v]; k < g.start[v+1]; ++k) {
+        if ((cost_to_double(g.cost[k]) < delta) != light) continue;
+        int w = g.to[k];
+        requests[t][w % num_workers].push_back(Request{w, v, dist[v] + g.cost[k]});
+      }
+    };
+    auto receive = [&]() {
+      for (int from = 0; from < num_workers; ++from) {
+        for (auto const& r : requests[from][t]) {
+          if (pred[r.node] == -2 || r.dist < dist[r.node]) {
+            dist[r.node] = r.dist;
+            pred[r.node] = r.pred;
+            // never go back to a bucket that is done, even if rounding says so
+            size_t rb = max(b, bucket_of(r.dist));
+            if (rb >= my_buckets.size()) my_buckets.resize(rb + 1);
+            my_buckets[rb].push_back(r.node);
+            in_bucket[r.node] = rb;
+          }
+        }
+        requests[from][t].clear();
+      }
+    };
+    while (true) {
+      // relax light edges until bucket b is empty in all threads
+      while (true) {
+        current.clear();
+        if (b < my_buckets.size()) current.swap(my_buckets[b]);
+        for (int v : current) {
+          if (in_bucket[v] != b) continue;
+          settled.push_back(v);
+          send(v, true);
+        }
+        barrier.wait();
+        receive();
+        more[t] = b < my_buckets.size() && !my_buckets[b].empty();
+        barrier.wait();
+        if (find(more.begin(), more.end(), 1) == more.end()) break;
+      }
+      // distances of nodes in bucket b are final now, relax their heavy edges
+      sort(settled.begin(), settled.end());
+      settled.erase(unique(settled.begin(), settled.end()), settled.end());
+      for (int v : settled) {
+        send(v, false);
+      }
+      settled.clear();
+      barrier.wait();
+      receive();
+      // continue with the lowest bucket that is not empty in any thread
+      next_bucket[t] = NO_BUCKET;
+      for (size_t k = b; k < my_buckets.size(); ++k) {
+        if (!my_buckets[k].empty()) {
+          next_bucket[t] = k;
+          break;
+        }
+      }
+      barrier.wait();
+      b = *min_element(next_bucket.begin(), next_bucket.end());
+      if (b == NO_BUCKET) break;
+    }
+  };
+  vector<thread> threads;
+  for (int t = 1; t < num_workers; ++t) {
+    threads.push_back(phase_thread([&worker, t]() { worker(t); }));
+  }
+  worker(0);
+  for (auto& th : threads) th.join();
+  
+  Paths<Cost> paths;
+  for (size_t v = 0; v < n; ++v) {
+    if (pred[v] == -2) continue;
+    paths.emplace_hint(paths.end(), g.keys[v], Path<Cost>{pred[v] < 0 ? -1 : g.keys[pred[v]], dist[v]});
+  }
+  LOG(LOG_DIJKSTRA, LOG_DEBUG, "delta-stepping from %d with %d threads: %d nodes reachable", i0, num_workers, (int)paths.size());
+  return paths;
+}
+
+// Choose the single source shortest path algorithm for a graph
+template <typename Weights, typename Cost = typename Weights::Cost>
+ShortestPathAlgorithm select_shortest_path_algorithm() {
+  if (shortest_path_algorithm != SSSP_AUTO) return shortest_path_algorithm;
+  if (num_threads > 1 && DeltaSteppingCost<Cost>::value && min_edge_cost >= 0 && graph_size >= MIN_AUTO_DELTA_NODES) return SSSP_DELTA;
+  if (Weights::policy == WEIGHTS_UNIT) return SSSP_BFS;
+  if (CostTraits<Cost>::integer && min_edge_cost >= 0 && max_edge_cost <= MAX_AUTO_BUCKETS) return SSSP_BUCKETS;
+  return SSSP_DIJKSTRA;
+}
+
+// Shortest path trees by source node.
+// When they use more than path_tree_cache_budget bytes, the least recently used trees are dropped.
+// The most recent tree is always kept, so a tree returned by get or insert stays valid until the next insert.
+template <typename Cost>
+class PathTreeCache {
+ public:
+  // the tree from node i, or nullptr if it is not cached
+  PathTree<Cost> const* get(int i) {
+    auto it = index.find(i);
+    if (it == index.end()) {
+      count(COUNT_TREE_CACHE_MISSES);
+      return nullptr;
+    }
+    count(COUNT_TREE_CACHE_HITS);
+    lru.splice(lru.begin(), lru, it->second);
+    return &it->second->second;
+  }
+  bool contains(int i) const {
+    return index.count(i) > 0;
+  }
+  PathTree<Cost> const& insert(int i, PathTree<Cost>&& tree) {
+    tree.steps.shrink_to_fit();
+    bytes += tree.bytes();
+    lru.emplace_front(i, move(tree));
+    index[i] = lru.begin();
+    while (path_tree_cache_budget && bytes > path_tree_cache_budget && lru.size() > 1) {
+      LOG(LOG_DIJKSTRA, LOG_DEBUG, "drop shortest paths from %d", lru.back().first);
+      count(COUNT_TREE_CACHE_EVICTIONS);
+      bytes -= lru.back().second.bytes();
+      index.erase(lru.back().first);
+      lru.pop_back();
+    }
+    distance_cache_sources = (int)lru.size();
+    return lru.front().second;
+  }
+  
+ private:
+  typedef list<pair<int,PathTree<Cost>>,CountingAllocator<pair<int,PathTree<Cost>>,MEM_DISTANCES>> List;
+  List lru; // most recently used first
+  unordered_map<int,typename List::iterator> index;
+  size_t bytes = 0;
+};
+
+// The graph doesn't change once it is built, so the cached trees stay valid for as long as the same graph is used
+template <typename Weights, typename Cost = typename Weights::Cost>
+PathTreeCache<Cost>& path_tree_cache(Graph<Weights> const& graph) {
+  static Graph<Weights> const* cached_graph = nullptr;
+  static PathTreeCache<Cost> cache;
+  if (cached_graph != &graph) {
+    cached_graph = &graph;
+    cache = PathTreeCache<Cost>();
+  }
+  return cache;
+}
+
+// Shortest paths from node i, calculated if they are not cached.
+// The tree stays valid until shortest paths from another node are calculated.
+template <typename Weights, typename Cost = typename Weights::Cost>
+PathTree<Cost> const& shortest_path_tree(Graph<Weights> const& graph, int i) {
+  PathTreeCache<Cost>& cache = path_tree_cache(graph);
+  if (PathTree<Cost> const* tree = cache.get(i)) return *tree;
+  Paths<Cost> paths;
+  switch (select_shortest_path_algorithm<Weights>()) {
+    case SSSP_BFS:     paths = shortest_paths_bfs(graph, i); break;
+    case SSSP_BUCKETS: paths = shortest_paths_buckets(graph, i); break;
+    case SSSP_DELTA:   paths = shortest_paths_delta(graph, i); break;
+    default:           paths = shortest_paths(graph, i); break;
+  }
+  PathTree<Cost> const& tree = cache.insert(i, PathTree<Cost>(paths));
+  check_distance_cache_limit(graph.size());
+  return tree;
+}
+
+// Bit-parallel breadth first search from up to 64 sources at once.
+// Nodes are numbered densely here, edges of node v are adj[adj_start[v]..adj_start[v+1]).
+// Bit s in the masks of a node means that it has been reached from sources[s].
+template <typename Cost>
+void cache_shortest_paths_bfs64(PathTreeCache<Cost>& cache, vector<int> const& keys,
+                                vector<int> const& adj_start, vector<int> const& adj, Cost step,
+                                int const* sources, int num_sources) {
+  ScopedTimer timer(PHASE_SHORTEST_PATHS, keys[sources[0]]);
+  typedef typename PathTree<Cost>::Step Step;
+  size_t n = keys.size();
+  vector<uint64_t> seen(n), frontier(n), next(n);
+  // the nodes with a frontier mask, so a level doesn't have to look at all nodes
+  vector<int> active, next_active;
+  vector<PathTree<Cost>> trees(num_sources);
+  for (int s = 0; s < num_sources; ++s) {
+    int v = sources[s];
+    seen[v] = frontier[v] = (uint64_t)1 << s;
+    active.push_back(v);
+    trees[s].steps.push_back(Step{keys[v], -1, Cost(0)});
+  }
+  Cost d(0);
+  while (!active.empty()) {
+    d += step;
+    for (int v : active) {
+      for (int k = adj_start[v]; k < adj_start[v+1]; ++k) {
+        count(COUNT_BFS_EDGES);
+        int w = adj[k];
+        uint64_t found = frontier[v] & ~seen[w];
+        if (!found) continue;
+        seen[w] |= found;
+        if (!next[w]) next_active.push_back(w);
+        next[w] |= found;
+        for (; found; found &= found - 1) {
+          trees[__builtin_ctzll(found)].steps.push_back(Step{keys[w], keys[v], d});
+        }
+      }
+    }
+    // clear the old frontier, which becomes the next one
+    for (int v : active) frontier[v] = 0;
+    frontier.swap(next);
+    active.swap(next_active);
+    next_active.clear();
+  }
+  for (int s = 0; s < num_sources; ++s) {
+    auto& steps = trees[s].steps;
+    sort(steps.begin(), steps.end(), [](Step const& a, Step const& b) { return a.node < b.node; });
+    cache.insert(keys[sources[s]], move(trees[s]));
+  }
+  LOG(LOG_DIJKSTRA, LOG_DEBUG, "bfs from %d sources starting at %d", num_sources, keys[sources[0]]);
+}
+
+// Floyd-Warshall on a distance matrix, for dense graphs.
+// The matrix is processed in blocks of FLOYD_BLOCK x FLOYD_BLOCK, so that the blocks used in the inner loops stay in the cache.
+// pred[i*n+j] is the previous node on the shortest path from i to j.
+const int FLOYD_BLOCK = 64;
+
+// Relax d[i][j] via node k, for k, i and j in the given blocks
+template <typename Cost>
+void floyd_warshall_block(Cost* d, int32_t* pred, size_t n, size_t kb, size_t ib, size_t jb) {
+  for (size_t k = kb; k < kb + FLOYD_BLOCK; ++k) {
+    Cost const* d_k = d + k * n;
+    int32_t const* pred_k = pred + k * n;
+    for (size_t i = ib; i < ib + FLOYD_BLOCK; ++i) {
+      Cost* d_i = d + i * n;
+      int32_t* pred_i = pred + i * n;
+      Cost d_ik = d_i[k];
+      for (size_t j = jb; j < jb + FLOYD_BLOCK; ++j) {
+        Cost via = d_ik + d_k[j];
+        if (via < d_i[j]) {
+          d_i[j] = via;
+          pred_i[j] = pred_k[j];
+        }
+      }
+    }
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+// The same with AVX2, 8 distances at a time
+__attribute__((target("avx2")))
+void floyd_warshall_block_avx2(int32_t* d, int32_t* pred, size_t n, size_t kb, size_t ib, size_t jb) {
+  for (size_t k = kb; k < kb + FLOYD_BLOCK; ++k) {
+    int32_t const* d_k = d + k * n;
+    int32_t const* pred_k = pred + k * n;
+    for (size_t i = ib; i < ib + FLOYD_BLOCK; ++i) {
+      int32_t* d_i = d + i * n;
+      int32_t* pred_i = pred + i * n;
+      __m256i d_ik = _mm256_set1_epi32(d_i[k]);
+      for (size_t j = jb; j < jb + FLOYD_BLOCK; j += 8) {
+        __m256i via  = _mm256_add_epi32(d_ik, _mm256_loadu_si256((__m256i const*)(d_k + j)));
+        __m256i d_ij = _mm256_loadu_si256((__m256i const*)(d_i + j));
+        __m256i less = _mm256_cmpgt_epi32(d_ij, via);
+        _mm256_storeu_si256((__m256i*)(d_i + j), _mm256_min_epi32(d_ij, via));
+        __m256i pred_ij = _mm256_blendv_epi8(_mm256_loadu_si256((__m256i const*)(pred_i + j)),
+                                             _mm256_loadu_si256((__m256i const*)(pred_k + j)), less);
+        _mm256_storeu_si256((__m256i*)(pred_i + j), pred_ij);
+      }
+    }
+  }
+}
+
+void floyd_warshall_block(int32_t* d, int32_t* pred, size_t n, size_t kb, size_t ib, size_t jb) {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2) {
+    floyd_warshall_block_avx2(d, pred, n, kb, ib, jb);
+  } else {
+    floyd_warshall_block<int32_t>(d, pred, n, kb, ib, jb);
+  }
+}
+#endif
+
+// n must be a multiple of FLOYD_BLOCK
+template <typename Cost>
+void floyd_warshall(Cost* d, int32_t* pred, size_t n) {
+  for (size_t kb = 0; kb < n; kb += FLOYD_BLOCK) {
+    // the block on the diagonal depends only on itself
+    floyd_warshall_block(d, pred, n, kb, kb, kb);
+    // then the blocks in the same row and column, which depend on the diagonal block
+    for (size_t b = 0; b < n; b += FLOYD_BLOCK) {
+      if (b == kb) continue;
+      floyd_warshall_block(d, pred, n, kb, kb, b);
+      floyd_warshall_block(d, pred, n, kb, b, kb);
+    }
+    // and all other blocks
+    for (size_t ib = 0; ib < n; ib += FLOYD_BLOCK) {
+      if (ib == kb) continue;
+      for (size_t jb = 0; jb < n; jb += FLOYD_BLOCK) {
+        if (jb == kb) continue;
+        floyd_warshall_block(d, pred, n, kb, ib, jb);
+      }
+    }
+  }
+}
+
+// Use Floyd-Warshall for graphs with at least MIN_AUTO_FLOYD_NODES and at most MAX_AUTO_FLOYD_NODES nodes, where at least
+// 1/FLOYD_DENSITY of all pairs of nodes have an edge. Smaller graphs would be padded to a whole block, which is slower than Dijkstra.
+const size_t MIN_AUTO_FLOYD_NODES = 256;
+const size_t MAX_AUTO_FLOYD_NODES = 4096;
+const size_t MAX_FLOYD_NODES = 32768;
+const size_t FLOYD_DENSITY = 8;
+
+// Floyd-Warshall is only implemented for plain integer costs, where there is room for an infinite distance
+template <typename Cost>
+using FloydWarshallCost = integral_constant<bool, is_same<Cost,int32_t>::value || is_same<Cost,int64_t>::value>;
+
+template <typename Weights>
+bool use_floyd_warshall(Graph<Weights> const& graph) {
+  typedef typename Weights::Cost Cost;
+  if (shortest_path_algorithm == SSSP_FLOYD) return true;
+  if (shortest_path_algorithm != SSSP_AUTO || Weights::policy == WEIGHTS_UNIT) return false;
+  if (!FloydWarshallCost<Cost>::value || min_edge_cost < 0) return false;
+  if (graph.size() < MIN_AUTO_FLOYD_NODES || graph.size() > MAX_AUTO_FLOYD_NODES) return false;
+  // count pairs, parallel edges and self loops don't make a graph dense
+  size_t pairs = 0;
+  vector<int> neighbours;
+  for (auto const& node : graph) {
+    neighbours.clear();
+    for (auto const& edge : node.second.edges) {
+      if (edge.to != node.first) neighbours.push_back(edge.to);
+    }
+    sort(neighbours.begin(), neighbours.end());
+    pairs += unique(neighbours.begin(), neighbours.end()) - neighbours.begin();
+  }
+  // in undirected graphs every pair is counted from both ends
+  if (!directed) pairs /= 2;
+  return pairs * FLOYD_DENSITY >= graph.size() * graph.size();
+}
+
+template <typename Weights, typename Cost>
+void cache_all_shortest_paths_floyd_warshall(Graph<Weights> const&, PathTreeCache<Cost>&, false_type) {
+  throw "Floyd-Warshall needs the int32 or int64 cost type";
+}
+
+// Calculate shortest paths from all nodes at once with Floyd-Warshall
+template <typename Weights, typename Cost>
+void cache_all_shortest_paths_floyd_warshall(Graph<Weights> const& graph, PathTreeCache<Cost>& cache, true_type) {
+  ScopedTimer timer(PHASE_SHORTEST_PATHS);
+  if (graph.size() > MAX_FLOYD_NODES) throw "Graph is too large for Floyd-Warshall";
+  // the graph is a map, so keys are sorted and we can number nodes densely
+  vector<int> keys;
+  for (auto const& node : graph) keys.push_back(node.first);
+  size_t n = (keys.size() + FLOYD_BLOCK - 1) / FLOYD_BLOCK * FLOYD_BLOCK;
+  // infinity + infinity doesn't overflow
+  const Cost infinity = numeric_limits<Cost>::max() / 2;
+  vector<Cost,CountingAllocator<Cost,MEM_DISTANCES>> d(n * n, infinity);
+  vector<int32_t,CountingAllocator<int32_t,MEM_DISTANCES>> pred(n * n, -1);
+  for (size_t i = 0; i < n; ++i) {
+    d[i * n + i] = Cost(0);
+  }
+  size_t i = 0;
+  for (auto const& node : graph) {
+    for (auto const& e : node.second.edges) {
+      size_t j = lower_bound(keys.begin(), keys.end(), e.to) - keys.begin();
+      Cost cost = e.cost(node.first);
+      if (i != j && cost < d[i * n + j]) {
+        d[i * n + j] = cost;
+        pred[i * n + j] = (int32_t)i;
+      }
+    }
+    ++i;
+  }
+  floyd_warshall(d.data(), pred.data(), n);
+  for (i = 0; i < keys.size(); ++i) {
+    if (cache.contains(keys[i])) continue;
+    PathTree<Cost> tree;
+    for (size_t j = 0; j < keys.size(); ++j) {
+      Cost dist = d[i * n + j];
+      if (dist >= infinity) continue;
+      int prev = i == j ? -1 : keys[pred[i * n + j]];
+      tree.steps.push_back(typename PathTree<Cost>::Step{keys[j], prev, dist});
+    }
+    cache.insert(keys[i], move(tree));
+  }
+  check_distance_cache_limit(graph.size());
+  LOG(LOG_DIJKSTRA, LOG_DEBUG, "floyd-warshall: %d nodes", (int)keys.size());
+}
+
+// Calculate shortest paths from all nodes, if they are not cached yet.
+// This is done in bulk where possible, with Floyd-Warshall or a BFS from 64 sources at a time.
+// A bounded cache might not have room for all of them, so then they are only calculated when needed.
+template <typename Weights, typename Cost = typename Weights::Cost>
+void cache_all_shortest_paths(Graph<Weights> const& graph) {
+  if (path_tree_cache_budget) return;
+  PathTreeCache<Cost>& cache = path_tree_cache(graph);
+  // the graph is a map, so keys are sorted
+  vector<int> keys, pending;
+  for (auto const& node : graph) {
+    if (!cache.contains(node.first)) pending.push_back((int)keys.size());
+    keys.push_back(node.first);
+  }
+  if (pending.empty()) return;
+  if (use_floyd_warshall(graph)) {
+    cache_all_shortest_paths_floyd_warshall(graph, cache, FloydWarshallCost<Cost>());
+    return;
+  }
+  if (select_shortest_path_algorithm<Weights>() != SSSP_BFS) {
+    for (int v : pending) {
+      shortest_path_tree(graph, keys[v]);
+    }
+    return;
+  }
+  // With unit weights, do a bit-parallel BFS from 64 sources at a time, on a compact copy of the graph
+  vector<int> adj_start, adj;
+  Cost step(0);
+  for (auto const& node : graph) {
+    adj_start.push_back((int)adj.size());
+    for (auto const& e : node.second.edges) {
+      adj.push_back((int)(lower_bound(keys.begin(), keys.end(), e.to) - keys.begin()));
+      step = e.cost(node.first);
+    }
+  }
+  adj_start.push_back((int)adj.size());
+  for (size_t b = 0; b < pending.size(); b += 64) {
+    int num_sources = (int)min<size_t>(64, pending.size() - b);
+    cache_shortest_paths_bfs64(cache, keys, adj_start, adj, step, &pending[b], num_sources);
+    check_distance_cache_limit(graph.size());
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Contraction hierarchy
+// -----------------------------------------------------------------------------
+
+// A contraction hierarchy answers shortest path queries between pairs of nodes, without storing distances from all nodes.
+// It is built once: nodes are contracted one by one, and when a node is removed, shortcuts are added between its neighbours
+// where that is needed to keep their distance the same.
+// A query is a bidirectional Dijkstra that only follows arcs to nodes that were contracted later, which visits few nodes.
+template <typename Weights>
+struct ContractionHierarchy {
+  typedef typename Weights::Cost Cost;
+  struct Arc {
+    int  to;     // dense node number
+    Cost cost;
+    int  middle; // node that this shortcut skips, or -1 for an edge of the graph
+  };
+  typedef vector<Arc,CountingAllocator<Arc,MEM_DISTANCES>> Arcs;
+  
+  vector<int>  keys; // nodes of the graph by dense number, in sorted order
+  vector<Arcs> up;   // arcs to nodes that were contracted later
+  
+  ContractionHierarchy(Graph<Weights> const& graph);
+  // Shortest distance between nodes i and j of the graph, returns false if there is no path
+  bool distance(int i, int j, Cost& cost) const;
+  // Nodes on a shortest path from i to j, including both, are appended to out
+  void path(int i, int j, vector<int>& out) const;
+  
+ private:
+  // only used while building
+  vector<Arcs> arcs; // arcs between nodes that are not contracted yet
+  
+  int index(int key) const {
+    return (int)(lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+  }
+  // The arc between a and b is stored with the one that was contracted first
+  Arc const& find_arc(int a, int b) const {
+    for (auto const& arc : up[a]) if (arc.to == b) return arc;
+    for (auto const& arc : up[b]) if (arc.to == a) return arc;
+    throw "Missing arc in contraction hierarchy";
+  }
+  void add_arc(int a, int b, Cost cost, int middle);
+  void remove_arc(int a, int b);
+  struct Shortcut { int a, b; Cost cost; };
+  void find_shortcuts(int v, vector<Shortcut>& shortcuts);
+  
+  // Scratch space for searches, entries are only valid if their stamp is current
+  struct Search {
+    vector<Cost> dist;
+    vector<int>  parent;     // previous node
+    vector<int>  parent_arc; // index of the arc in up[parent]
+    vector<unsigned> stamp;
+    priority_queue<pair<Cost,int>,vector<pair<Cost,int>>,greater<pair<Cost,int>>> queue;
+    
+    void resize(size_t n) {
+      dist.resize(n); parent.resize(n); parent_arc.resize(n); stamp.resize(n, 0);
+    }
+    bool reached(int v, unsigned current) const { return stamp[v] == current; }
+    void reach(int v, unsigned current, Cost d, int p, int arc) {
+      stamp[v] = current; dist[v] = d; parent[v] = p; parent_arc[v] = arc;
+      queue.push(make_pair(d,v));
+    }
+  };
+  mutable Search searches[2];
+  mutable unsigned current_stamp = 0;
+  
+  bool query(int s, int t, Cost& best, int& meet) const;
+};
+
+template <typename Weights>
+void ContractionHierarchy<Weights>::add_arc(int a, int b, Cost cost, int middle) {
+  for (auto& arc : arcs[a]) {
+    if (arc.to == b) {
+      if (cost < arc.cost) {
+        arc.cost = cost;
+        arc.middle = middle;
+        for (auto& rev : arcs[b]) {
+          if (rev.to == a) rev = Arc{a, cost, middle};
+        }
+      }
+      return;
+    }
+  }
+  arcs[a].push_back(Arc{b, cost, middle});
+  arcs[b].push_back(Arc{a, cost, middle});
+}
+
+template <typename Weights>
+void ContractionHierarchy<Weights>::remove_arc(int a, int b) {
+  for (auto& arc : arcs[a]) {
+    if (arc.to == b) {
+      arc = arcs[a].back();
+      arcs[a].pop_back();
+      return;
+    }
+  }
+}
+
+// Shortcuts that are needed when contracting node v.
+// A shortcut between neighbours a and b is not needed if there is a path that is at least as short without v (a witness).
+// The search for witnesses is limited, when none is found we add a shortcut that might not be needed, which is still correct.
+const int CH_WITNESS_SETTLED_LIMIT = 200;
+
+template <typename Weights>
+void ContractionHierarchy<Weights>::find_shortcuts(int v, vector<Shortcut>& shortcuts) {
+  shortcuts.clear();
+  Search& search = searches[0];
+  for (size_t x = 0; x + 1 < arcs[v].size(); ++x) {
+    Arc const& a = arcs[v][x];
+    // the longest path through v that we need to beat
+    Cost limit = a.cost;
+    for (size_t y = x + 1; y < arcs[v].size(); ++y) {
+      limit = max(limit, a.cost + arcs[v][y].cost);
+    }
+    // Dijkstra from a, avoiding v
+    unsigned current = ++current_stamp;
+    search.queue = decltype(search.queue)();
+    search.reach(a.to, current, Cost(0), -1, -1);
+    int settled = 0;
+    while (!search.queue.empty() && settled < CH_WITNESS_SETTLED_LIMIT) {
+      Cost d = search.queue.top().first;
+      int  u = search.queue.top().second;
+      search.queue.pop();
+      if (search.dist[u] < d) continue;
+      if (limit < d) break;
+      settled++;
+      for (auto const& e : arcs[u]) {
+        if (e.to == v) continue;
+        Cost dv = d + e.cost;
+        if (!search.reached(e.to, current) || dv < search.dist[e.to]) {
+          search.reach(e.to, current, dv, u, -1);
+        }
+      }
+    }
+    for (size_t y = x + 1; y < arcs[v].size(); ++y) {
+      Arc const& b = arcs[v][y];
+      Cost via = a.cost + b.cost;
+      if (!search.reached(b.to, current) || via < search.dist[b.to]) {
+        shortcuts.push_back(Shortcut{a.to, b.to, via});
+      }
+    }
+  }
+}
+
+template <typename Weights>
+ContractionHierarchy<Weights>::ContractionHierarchy(Graph<Weights> const& graph) {
+  ScopedTimer timer(PHASE_CH_BUILD);
+  for (auto const& node : graph) keys.push_back(node.first);
+  size_t n = keys.size();
+  arcs.resize(n);
+  up.resize(n);
+  searches[0].resize(n);
+  searches[1].resize(n);
+  for (auto const& node : graph) {
+    int i = index(node.first);
+    for (auto const& e : node.second.edges) {
+      // self loops are never part of a shortest path, and of parallel edges we only need the shortest
+      int j = index(e.to);
+      if (i != j) add_arc(i, j, e.cost(node.first), -1);
+    }
+  }
+  // Contract the node that adds the fewest shortcuts compared to the arcs it removes first.
+  // Priorities change when neighbours are contracted, so they are updated lazily when a node comes up.
+  vector<Shortcut> shortcuts;
+  vector<int> contracted_neighbours(n, 0);
+  auto priority = [&](int v) {
+    find_shortcuts(v, shortcuts);
+    return (int)shortcuts.size() - (int)arcs[v].size() + contracted_neighbours[v];
+  };
+  priority_queue<pair<int,int>,vector<pair<int,int>>,greater<pair<int,int>>> order;
+  for (int v = 0; v < (int)n; ++v) {
+    order.push(make_pair(priority(v), v));
+  }
+  long num_shortcuts = 0;
+  while (!order.empty()) {
+    int v = order.top().second;
+    order.pop();
+    int p = priority(v);
+    if (!order.empty() && p > order.top().first) {
+      order.push(make_pair(p, v));
+      continue;
+    }
+    // shortcuts were found by priority(v)
+    up[v] = arcs[v];
+    for (auto const& a : arcs[v]) {
+      remove_arc(a.to, v);
+      contracted_neighbours[a.to]++;
+    }
+    arcs[v].clear();
+    for (auto const& s : shortcuts) {
+      add_arc(s.a, s.b, s.cost, v);
+    }
+    num_shortcuts += (long)shortcuts.size();
+  }
+  arcs.clear();
+  LOG(LOG_DIJKSTRA, LOG_INFO, "contraction hierarchy: %d nodes, %ld shortcuts", (int)n, num_shortcuts);
+}
+
+// Bidirectional search from s and t, only going up in the hierarchy.
+// Returns the length of the shortest path and the highest node on it.
+template <typename Weights>
+bool ContractionHierarchy<Weights>::query(int s, int t, Cost& best, int& meet) const {
+  unsigned current = ++current_stamp;
+  for (int dir = 0; dir < 2; ++dir) {
+    searches[dir].queue = decltype(searches[dir].queue)();
+    searches[dir].reach(dir == 0 ? s : t, current, Cost(0), -1, -1);
+  }
+  bool found = false;
+  while (true) {
+    // continue in the direction with the closest node, until both can only find longer paths
+    int dir = -1;
+    for (int d = 0; d < 2; ++d) {
+      auto const& queue = searches[d].queue;
+      if (queue.empty() || (found && !(queue.top().first < best))) continue;
+      if (dir < 0 || queue.top().first < searches[dir].queue.top().first) dir = d;
+    }
+    if (dir < 0) break;
+    Search& search = searches[dir];
+    Search const& other = searches[1 - dir];
+    Cost d = search.queue.top().first;
+    int  u = search.queue.top().second;
+    search.queue.pop();
+    if (search.dist[u] < d) continue;
+    if (other.reached(u, current) && (!found || d + other.dist[u] < best)) {
+      best = d + other.dist[u];
+      meet = u;
+      found = true;
+    }
+    for (int k = 0; k < (int)up[u].size(); ++k) {
+      Arc const& a = up[u][k];
+      Cost dv = d + a.cost;
+      if (!search.reached(a.to, current) || dv < search.dist[a.to]) {
+        search.reach(a.to, current, dv, u, k);
+      }
+    }
+  }
+  return found;
+}
+
+template <typename Weights>
+bool ContractionHierarchy<Weights>::distance(int i, int j, Cost& cost) const {
+  int meet;
+  return query(index(i), index(j), cost, meet);
+}
+
+template <typename Weights>
+void ContractionHierarchy<Weights>::path(int i, int j, vector<int>& out) const {
+  Cost cost;
+  int meet;
+  if (!query(index(i), index(j), cost, meet)) return;
+  // arcs on the path, from i up to meet and down to j
+  vector<pair<int,int>> todo; // (from, to) in reverse order
+  for (int v = meet; searches[1].parent[v] >= 0; v = searches[1].parent[v]) {
+    todo.insert(todo.begin(), make_pair(v, searches[1].parent[v]));
+  }
+  for (int v = meet; searches[0].parent[v] >= 0; v = searches[0].parent[v]) {
+    todo.push_back(make_pair(searches[0].parent[v], v));
+  }
+  // unpack shortcuts, a shortcut a-b that skips m was made from the arcs m-a and m-b
+  out.push_back(i);
+  while (!todo.empty()) {
+    int a = todo.back().first, b = todo.back().second;
+    todo.pop_back();
+    int middle = find_arc(a, b).middle;
+    if (middle < 0) {
+      out.push_back(keys[b]);
+    } else {
+      todo.push_back(make_pair(middle, b));
+      todo.push_back(make_pair(a, middle));
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Min cost flow
+// -----------------------------------------------------------------------------
+
+// In a directed graph there is a trail from i0 to i1 that uses all arcs if every node has as many arcs out as in,
+// except that i0 has one more out and i1 one more in. The arcs to remove are a flow from the nodes with too many
+// arcs out to the nodes with too many arcs in, and the cheapest such flow takes the place of the matching.
+// Each copy of an arc can only be removed once, so the capacities are those of the arcs.
+// This uses successive shortest paths: Dijkstra with reduced costs c(u,v) + pi[u] - pi[v], which stay non-negative,
+// in the residual graph where removed arcs can also be put back.
+// The flow is kept between calls. For the next i1 only two nodes change, so usually a single path fixes it.
+template <typename Cost>
+struct BalancingFlow {
+  CompactGraph<Cost> const& g;
+  vector<int> from;              // tail of every arc
+  vector<int> in_start, in_arcs; // arcs into node v are in_arcs[in_start[v]..in_start[v+1])
+  vector<int>  capacity;         // copies of every arc
+  vector<int>  removed;          // the flow, copies of arcs that are removed
+  vector<Cost> pi;               // potentials
+  vector<int>  balance;          // what the flow should send out of each node
+  vector<int>  missing;          // what it still needs to send, when that is not yet possible
+  
+  BalancingFlow(CompactGraph<Cost> const& g, vector<int> const& capacity)
+    : g(g), from(g.to.size()), in_start(g.keys.size() + 1), capacity(capacity), removed(g.to.size()),
+      pi(g.keys.size(), Cost(0)), balance(g.keys.size()), missing(g.keys.size()),
+      dist(g.keys.size()), pred(g.keys.size()), state(g.keys.size()) {
+    for (size_t v = 0; v + 1 < g.start.size(); ++v) {
+      for (int k = g.start[v]; k < g.start[v+1]; ++k) {
+        from[k] = (int)v;
+        in_start[g.to[k] + 1]++;
+      }
+    }
+    for (size_t v = 0; v < g.keys.size(); ++v) in_start[v+1] += in_start[v];
+    in_arcs.resize(g.to.size());
+    vector<int> pos(in_start.begin(), in_start.end() - 1);
+    for (size_t k = 0; k < g.to.size(); ++k) in_arcs[pos[g.to[k]]++] = (int)k;
+  }
+  
+  // Find the cheapest set of arcs to remove, such that every node v sends excess[v] more arcs out than in.
+  // Returns false if there is no such set.
+  bool solve(vector<int> const& excess) {
+    for (size_t v = 0; v < excess.size(); ++v) {
+      missing[v] += excess[v] - balance[v];
+    }
+    balance = excess;
+    while (true) {
+      int sink = shortest_path();
+      if (sink == -2) return true;
+      if (sink < 0) return false;
+      int v = sink;
+      missing[sink]++;
+      while (pred[v] != 0) {
+        int k = abs(pred[v]) - 1;
+        removed[k] += pred[v] > 0 ? 1 : -1;
+        v = pred[v] > 0 ? from[k] : g.to[k];
+      }
+      missing[v]--;
+      count(COUNT_FLOW_AUGMENTATIONS);
+    }
+  }
+  
+ private:
+  vector<Cost> dist;
+  vector<int>  pred;  // arc used to reach a node, as k+1 for a forward arc and -(k+1) for a removed arc that is put back
+  vector<char> state; // 0: not reached, 1: reached, 2: done
+  vector<int>  reached;
+  
+  // Dijkstra from all nodes with arcs left to send, until the nearest node that needs them.
+  // Returns that node, -1 if there is none, or -2 if no node has arcs left to send.
+  int shortest_path() {
+    priority_queue<pair<Cost,int>> pq;
+    auto relax = [&](int v, Cost d, int arc) {
+      if (state[v] == 0) reached.push_back(v);
+      if (state[v] == 0 || (state[v] == 1 && d < dist[v])) {
+        dist[v] = d;
+        pred[v] = arc;
+        state[v] = 1;
+        pq.push(make_pair(-d, v));
+        count(COUNT_HEAP_PUSH);
+      }
+    };
+    for (size_t v = 0; v < missing.size(); ++v) {
+      if (missing[v] > 0) relax((int)v, Cost(0), 0);
+    }
+    if (pq.empty()) return -2;
+    int sink = -1;
+    while (!pq.empty()) {
+      Cost d = -pq.top().first;
+      int  u = pq.top().second;
+      pq.pop();
+      count(COUNT_HEAP_POP);
+      if (state[u] == 2 || dist[u] < d) {
+        count(COUNT_HEAP_STALE_POP);
+        continue;
+      }
+      state[u] = 2;
+      if (missing[u] < 0) {
+        sink = u;
+        break;
+      }
+      for (int k = g.start[u]; k < g.start[u+1]; ++k) {
+        if (removed[k] < capacity[k]) relax(g.to[k], d + g.cost[k] + pi[u] - pi[g.to[k]], k + 1);
+      }
+      for (int a = in_start[u]; a < in_start[u+1]; ++a) {
+        int k = in_arcs[a];
+        if (removed[k]) relax(from[k], d - g.cost[k] + pi[u] - pi[from[k]], -(k + 1));
+      }
+    }
+    // Nodes that are not done are at least as far as the sink, lowering the potentials of the others
+    // by how much closer they are keeps all reduced costs non-negative, and makes them 0 on the path.
+    for (int v : reached) {
+      if (sink >= 0 && state[v] == 2) pi[v] = pi[v] + dist[v] - dist[sink];
+      state[v] = 0;
+    }
+    reached.clear();
+    return sink;
+  }
+};
+
+// The graph doesn't change once it is built, so the in-arcs are only found once, and the flow is kept for the next query
+template <typename Weights, typename Cost = typename Weights::Cost>
+BalancingFlow<Cost>& balancing_flow(Graph<Weights> const& graph) {
+  static Graph<Weights> const* cached_graph = nullptr;
+  static unique_ptr<BalancingFlow<Cost>> flow;
+  if (cached_graph != &graph) {
+    cached_graph = &graph;
+    vector<int> capacity;
+    for (auto const& node : graph) {
+      for (auto const& e : node.second.edges) capacity.push_back(e.capacity);
+    }
+    flow.reset(new BalancingFlow<Cost>(compact_graph(graph), capacity));
+  }
+  return *flow;
+}
+
+// Path costs as weights for the matching.
+// blossom5 uses REAL for costs, which is int unless PERFECT_MATCHING_DOUBLE is defined in PerfectMatching.h.
+// Leave some headroom for the dual variables.
+const double MAX_MATCHING_WEIGHT = is_floating_point<REAL>::value ? 9007199254740992.0 : numeric_limits<REAL>::max() / 4;
+
+template <typename Cost>
+REAL matching_weight(Cost cost) {
+  if (cost_to_double(cost) > MAX_MATCHING_WEIGHT) {
+    throw "Path cost too large for the matching, define PERFECT_MATCHING_DOUBLE in blossom5's PerfectMatching.h";
+  }
+  return (REAL)cost_to_double(cost);
+}
+
+// Weights of the matching for the costs of the paths between exposed nodes, a perfect matching uses pairs of them
+template <typename Cost>
+vector<REAL> matching_weights(vector<Cost> const& costs, size_t) {
+  vector<REAL> weights;
+  for (auto const& cost : costs) weights.push_back(matching_weight(cost));
+  return weights;
+}
+
+// Lex keys leave room for the total weight of the graph, which doesn't fit in the matching for large graphs.
+// A matching only needs enough room for the weights of its own paths: edge counts and weights are taken relative to the
+// smallest ones, which changes every perfect matching by the same amount, and one edge more must outweigh any difference
+// in the weights of pairs paths.
+bool lex_matching_warned = false;
+
+vector<REAL> matching_weights(vector<Lex> const& costs, size_t pairs) {
+  vector<REAL> weights;
+  if (costs.empty()) return weights;
+  int64_t min_edges = costs[0].edges(), max_edges = min_edges, min_weight = costs[0].weight(), max_weight = min_weight;
+  for (auto const& cost : costs) {
+    min_edges  = min(min_edges, cost.edges());
+    max_edges  = max(max_edges, cost.edges());
+    min_weight = min(min_weight, cost.weight());
+    max_weight = max(max_weight, cost.weight());
+  }
+  double scale = (double)pairs * (double)(max_weight - min_weight) + 1;
+  if ((double)(max_edges - min_edges) * scale + (double)(max_weight - min_weight) <= MAX_MATCHING_WEIGHT) {
+    for (auto const& cost : costs) {
+      weights.push_back((REAL)((double)(cost.edges() - min_edges) * scale + (double)(cost.weight() - min_weight)));
+    }
+  } else {
+    // still the most edges, but not always the largest weight among those
+    if (!lex_matching_warned) {
+      fprintf(stderr, "warning: path weights are too large for the matching, only the number of edges is exact\n");
+      lex_matching_warned = true;
+    }
+    for (auto const& cost : costs) weights.push_back(matching_weight(cost.edges() - min_edges));
+  }
+  return weights;
+}
+
+// Total cost of the unmarked edges in the connected component of node i0, the nodes in it are added to seen.
+// After removing edges every node has even degree (or in a directed graph, as many arcs in as out), except for the
+// end points of the path, so there will exist an Euler path that uses all remaining edges of the component.
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost component_cost(Graph<Weights> const& graph, int i0, set<int>& seen) {
+  Cost total_cost(0);
+  vector<int> queue;
+  queue.push_back(i0);
   while (!queue.empty()) {
     int i = queue.back(); queue.pop_back();
     if (seen.count(i)) continue;
     seen.insert(i);
-    Node const& node_i = graph.at(i);
-    for (Edge const& e : node_i.edges) {
-      if (e.marked) continue;
-      total_cost += e.cost;
+    Node<Weights> const& node_i = graph.at(i);
+    for (Edge<Weights> const& e : node_i.edges) {
+      if (e.marked >= e.capacity) continue;
+      total_cost += cost_times(e.cost(i), e.capacity - e.marked);
       queue.push_back(e.to);
-      if (VERBOSE) printf("  count  %d - %d: %d\n", i, e.to, e.cost);
+      LOG(LOG_MARKING, LOG_TRACE, "count %d - %d: %s", i, e.to, cost_to_string(e.cost(i)).c_str());
+    }
+  }
+  return directed ? total_cost : total_cost / Cost(2); // undirected edges are counted from both ends
+}
+
+// Find connected component using only unmarked edges, and just count weight of the remaining edges
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost remaining_cost(Graph<Weights> const& graph, int i0, int i1) {
+  ScopedTimer timer(PHASE_COMPONENT);
+  set<int> seen;
+  Cost total = component_cost(graph, i0, seen);
+  LOG(LOG_MARKING, LOG_DEBUG, "component of %d - %d: %d nodes, cost %s", i0, i1, (int)seen.size(), cost_to_string(total).c_str());
+  return total;
+}
+
+// The connected component with the largest cost of unmarked edges
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost largest_component_cost(Graph<Weights> const& graph) {
+  ScopedTimer timer(PHASE_COMPONENT);
+  set<int> seen;
+  Cost largest(0);
+  for (auto const& node : graph) {
+    if (seen.count(node.first)) continue;
+    Cost total = component_cost(graph, node.first, seen);
+    LOG(LOG_MARKING, LOG_DEBUG, "component of %d: cost %s", node.first, cost_to_string(total).c_str());
+    largest = max(largest, total);
+  }
+  return largest;
+}
+
+// Find exposed nodes, and mapping to ids
+// A node is exposed if it has odd degree, counting an extra edge from i0 to i1  (if i0==i1 both end points count)
+// Each exposed node needs one if its incident edges removed.
+// An edge with capacity c counts c times, so only edges with an odd capacity change the parity of a node. When one copy is removed
+// the others are still there, so a capacity of 2 or more keeps the graph connected.
+template <typename Weights>
+vector<int> exposed_nodes(Graph<Weights> const& graph, int i0, int i1) {
+  ScopedTimer timer(PHASE_EXPOSED);
+  vector<int> exposed;
+  for (const auto& node : graph) {
+    node.second.id = -1; // not exposed
+  }
+  for (auto const& node : graph) {
+    int i = node.first;
+    int degree = node.second.degree();
+    if (i == i0) degree++;
+    if (i == i1) degree++;
+    if (degree % 2 == 1) {
+      node.second.id = (int)exposed.size();
+      exposed.push_back(i);
+      LOG(LOG_MATCHING, LOG_DEBUG, "exposed: %d -> [%d]  (degree: %d)", i, node.second.id, degree);
+    }
+  }
+  return exposed;
+}
+
+// Mark the cheapest set of edges that leaves a graph with an Euler path from i0 to i1, which is a minimum T-join.
+// (With i0 == i1 this is an Euler circuit, and the exposed nodes are just the nodes of odd degree.)
+// Shortest paths come from trees(i), unless a contraction hierarchy is given.
+template <typename Weights, typename Trees, typename Cost = typename Weights::Cost>
+void mark_removed_edges(Graph<Weights> const& graph, int i0, int i1, ContractionHierarchy<Weights> const* ch, Trees&& trees) {
+  vector<int> exposed = exposed_nodes(graph, i0, i1);
+  // set up PerfectMatching, using shortest paths between exposed nodes as weights
+  long heap_before_matching = collect_memory ? heap_in_use() : 0;
+  PerfectMatching matching((int)exposed.size(), (int)(exposed.size()*(exposed.size()-1)));
+  matching.options.verbose = false;
+  count(COUNT_MATCHING_NODES, (long)exposed.size());
+  {
+    ScopedTimer timer(PHASE_MATCHING_SETUP);
+    vector<pair<int,int>> ends; // ids of the exposed nodes at both ends of each path
+    vector<Cost> costs;
+    if (ch) {
+      ScopedTimer query_timer(PHASE_CH_QUERY);
+      for (size_t a = 0; a < exposed.size(); ++a) {
+        for (size_t b = a + 1; b < exposed.size(); ++b) {
+          Cost cost;
+          if (ch->distance(exposed[a], exposed[b], cost)) {
+            ends.push_back(make_pair((int)a, (int)b));
+            costs.push_back(cost);
+            LOG(LOG_MATCHING, LOG_TRACE, "[%d] - [%d] = %s", (int)a, (int)b, cost_to_string(cost).c_str());
+          }
+        }
+      }
+    } else {
+      for (auto i : exposed) {
+        Node<Weights> const& node_i = graph.at(i);
+        PathTree<Cost> const& tree = trees(i);
+        for (auto j : exposed) {
+          if (i < j) {
+            auto p = tree.find(j);
+            if (p) {
+              Node<Weights> const& node_j = graph.at(j);
+              ends.push_back(make_pair(node_i.id, node_j.id));
+              costs.push_back(p->cost);
+              LOG(LOG_MATCHING, LOG_TRACE, "[%d] - [%d] = %s  (path:%s)", node_i.id, node_j.id, cost_to_string(p->cost).c_str(),
+                  path_to_string(tree, j).c_str());
+            }
+          }
+        }
+      }
     }
+    vector<REAL> weights = matching_weights(costs, exposed.size() / 2);
+    for (size_t k = 0; k < ends.size(); ++k) {
+      matching.AddEdge(ends[k].first, ends[k].second, weights[k]);
+    }
+    count(COUNT_MATCHING_EDGES, (long)ends.size());
+  }
+  
+  // Solve perfect matching
+  {
+    ScopedTimer timer(PHASE_MATCHING_SOLVE);
+    matching.Solve(true);
+  }
+  if (collect_memory) {
+    // the matching is freed at the end of this function
+    long bytes = heap_in_use() - heap_before_matching;
+    track_memory(MEM_MATCHING, bytes);
+    track_memory(MEM_MATCHING, -bytes, 0);
   }
 
-  return total_cost / 2; // we double counted all edges
+  for (int id = 0; id < (int)exposed.size() ; ++id) {
+    LOG(LOG_MATCHING, LOG_DEBUG, "match: [%d] - [%d]", id, matching.GetMatch(id));
+  }
+  
+  // Mark all removed edges
+  {
+    ScopedTimer timer(PHASE_MARK_EDGES);
+    for (auto const& node : graph) {
+      for (auto const& e : node.second.edges) {
+        e.marked = 0;
+      }
+    }
+    vector<int> path; // reused for all matched pairs
+    for (int id = 0; id < (int)exposed.size() ; ++id) {
+      int i = exposed[id];
+      int j = exposed[matching.GetMatch(id)];
+      if (j < i) continue;
+      // mark the path from i to j
+      path.clear();
+      if (ch) {
+        ch->path(i, j, path);
+      } else {
+        trace_path(trees(i), j, path);
+      }
+      mark_path(graph, path);
+    }
+  }
+}
+template <typename Weights, typename Cost = typename Weights::Cost>
+void mark_removed_edges(Graph<Weights> const& graph, int i0, int i1, ContractionHierarchy<Weights> const* ch) {
+  mark_removed_edges(graph, i0, i1, ch, [&](int i) -> PathTree<Cost> const& { return shortest_path_tree(graph, i); });
 }
 
-map<int,Cost> longest_paths(map<int,Node> const& graph, int i0) {
+// In a directed graph, the arcs to remove are found with a min cost flow instead of a matching
+template <typename Weights, typename Cost = typename Weights::Cost>
+void mark_removed_arcs(Graph<Weights> const& graph, int i0, int i1) {
+  // Number of arcs each node has to send out in the flow: arcs out - arcs in, counting an extra arc from i1 to i0
+  CompactGraph<Cost> const& g = compact_graph(graph);
+  BalancingFlow<Cost>& flow = balancing_flow(graph);
+  vector<int> excess(g.keys.size());
+  {
+    ScopedTimer timer(PHASE_EXPOSED);
+    for (size_t v = 0; v < g.keys.size(); ++v) {
+      for (int k = g.start[v]; k < g.start[v+1]; ++k) {
+        excess[v] += flow.capacity[k];
+        excess[g.to[k]] -= flow.capacity[k];
+      }
+    }
+    // the graph is a map, so keys are sorted
+    excess[lower_bound(g.keys.begin(), g.keys.end(), i0) - g.keys.begin()]--;
+    excess[lower_bound(g.keys.begin(), g.keys.end(), i1) - g.keys.begin()]++;
+  }
+  
+  {
+    ScopedTimer timer(PHASE_FLOW);
+    if (!flow.solve(excess)) throw "No flow balances the graph";
+  }
+  
+  // Mark all removed arcs, the compact graph has the arcs of each node in the same order
+  {
+    ScopedTimer timer(PHASE_MARK_EDGES);
+    size_t v = 0;
+    for (auto const& node : graph) {
+      auto const& edges = node.second.edges;
+      for (size_t k = 0; k < edges.size(); ++k) {
+        edges[k].marked = (uint16_t)flow.removed[g.start[v] + k];
+        if (edges[k].marked) LOG(LOG_MARKING, LOG_TRACE, "mark %d -> %d", node.first, edges[k].to);
+      }
+      ++v;
+    }
+  }
+}
+
+template <typename Weights>
+void mark_removed(Graph<Weights> const& graph, int i0, int i1, ContractionHierarchy<Weights> const* ch) {
+  if (directed) {
+    mark_removed_arcs(graph, i0, i1);
+  } else {
+    mark_removed_edges(graph, i0, i1, ch);
+  }
+}
+
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost longest_path_to(Graph<Weights> const& graph, int i0, int i1, ContractionHierarchy<Weights> const* ch) {
+  ScopedTrace trace("query", i1);
+  // Is there even a path from i0 to i1?
+  if (!shortest_path_tree(graph, i0).find(i1)) {
+    return Cost(-1);
+  }
+  mark_removed(graph, i0, i1, ch);
+  return remaining_cost(graph, i0, i1);
+}
+
+template <typename Weights, typename Cost = typename Weights::Cost>
+map<int,Cost> longest_paths(Graph<Weights> const& graph, int i0, ContractionHierarchy<Weights> const* ch = nullptr) {
+  // every node is an end point of some query, so we will need shortest paths from all of them
+  if (!ch && !directed) cache_all_shortest_paths(graph);
   map<int,Cost> dist;
   for (auto const& node_to : graph) {
-    dist[node_to.first] = longest_path_to(graph, i0, node_to.first);
+    dist[node_to.first] = longest_path_to(graph, i0, node_to.first, ch);
   }
   return dist;
 }
 
+// Longest closed trail through i0.
+// This is a single query, that only needs shortest paths from the nodes of odd degree.
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost longest_circuit(Graph<Weights> const& graph, int i0, ContractionHierarchy<Weights> const* ch = nullptr) {
+  ScopedTrace trace("circuit", i0);
+  mark_removed(graph, i0, i0, ch);
+  return remaining_cost(graph, i0, i0);
+}
+
+// Longest closed trail anywhere in the graph.
+// After removing edges every node has even degree, so each connected component has an Euler circuit, take the best.
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost longest_any_circuit(Graph<Weights> const& graph, ContractionHierarchy<Weights> const* ch = nullptr) {
+  ScopedTrace trace("circuit");
+  // with i0 == i1 any node will do, it counts twice
+  int i0 = graph.begin()->first;
+  mark_removed(graph, i0, i0, ch);
+  return largest_component_cost(graph);
+}
+
+// Euler circuit from i0 with Hierholzer's algorithm, where every copy of an edge is walked once, and marked copies twice.
+// The nodes of the walk are stored in walk, and its cost is returned.
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost euler_walk(Graph<Weights> const& graph, int i0, vector<int>& walk) {
+  ScopedTimer timer(PHASE_EULER);
+  CompactGraph<Cost> const& g = compact_graph(graph);
+  // how often each half edge can still be walked, and the other half of the same edge
+  vector<int> left, rev;
+  for (auto const& node : graph) {
+    for (auto const& e : node.second.edges) {
+      left.push_back(e.capacity + e.marked);
+      rev.push_back(e.rev >= 0 ? g.start[g.to[left.size()-1]] + e.rev : -1);
+    }
+  }
+  vector<int> next(g.start.begin(), g.start.end() - 1); // first half edge of each node that may be left
+  vector<int> stack = {(int)(lower_bound(g.keys.begin(), g.keys.end(), i0) - g.keys.begin())};
+  Cost total(0);
+  walk.clear();
+  while (!stack.empty()) {
+    int u = stack.back();
+    while (next[u] < g.start[u+1] && left[next[u]] == 0) next[u]++;
+    if (next[u] == g.start[u+1]) {
+      // stuck, so this node is done
+      walk.push_back(g.keys[u]);
+      stack.pop_back();
+      continue;
+    }
+    int h = next[u];
+    left[h]--;
+    if (rev[h] >= 0) left[rev[h]]--;
+    total += g.cost[h];
+    stack.push_back(g.to[h]);
+  }
+  reverse(walk.begin(), walk.end());
+  LOG(LOG_MARKING, LOG_DEBUG, "walk from %d: %d steps, cost %s", i0, (int)walk.size() - 1, cost_to_string(total).c_str());
+  return total;
+}
+
+// Chinese postman: the shortest closed walk from i0 that uses every edge of its component at least once.
+// The odd degree nodes are fixed like for a circuit, only by walking the shortest paths between them twice instead of removing them.
+// So the marked edges are the ones to walk twice.
+template <typename Weights, typename Cost = typename Weights::Cost>
+Cost postman_walk(Graph<Weights> const& graph, int i0, ContractionHierarchy<Weights> const* ch, vector<int>& walk) {
+  ScopedTrace trace("postman", i0);
+  mark_removed_edges(graph, i0, i0, ch);
+  return euler_walk(graph, i0, walk);
+}
+
 // -----------------------------------------------------------------------------
-// Main
+// Edge sensitivity
 // -----------------------------------------------------------------------------
 
-// Edge weight/cost according to AoC2017-24 problem
-Cost edge_cost(int problem, int i, int j) {
-  if (problem == 1) {
-    return i+j;
-  } else {
-    return 10000000 + (i+j);
+// The answer when one copy of the edge i - j is lost
+template <typename Cost>
+struct EdgeSensitivity {
+  int  i, j;
+  Cost answer;
+};
+
+// Every edge once, as a node and the index in its edges: from its lowest end, and a self loop from its first half
+template <typename Weights>
+vector<pair<int,int>> edge_list(Graph<Weights> const& graph) {
+  vector<pair<int,int>> list;
+  for (auto const& node : graph) {
+    auto const& edges = node.second.edges;
+    for (size_t k = 0; k < edges.size(); ++k) {
+      int j = edges[k].to;
+      if (edges[k].rev >= 0 && (j < node.first || (j == node.first && edges[k].rev < (int)k))) continue;
+      list.push_back(make_pair(node.first, (int)k));
+    }
   }
+  return list;
 }
 
-// Main
-int main(int argc, const char** argv) {
-  // Usage: longest-path <brute> <input>
-  // Parse arguments
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s {brute|fast} [PROBLEM={1|2}] [FILE]\n", argv[0]);
-    return EXIT_FAILURE;
+// Take one copy of an edge away, or put it back
+template <typename Weights>
+void change_capacity(Graph<Weights>& graph, pair<int,int> edge, int change) {
+  auto& e = graph.at(edge.first).edges[edge.second];
+  e.capacity = (uint16_t)(e.capacity + change);
+  if (e.rev >= 0) {
+    auto& rev = graph.at(e.to).edges[e.rev];
+    rev.capacity = (uint16_t)(rev.capacity + change);
+  }
+}
+
+// Dijkstra on the compact graph, without the half edges skip1 and skip2.
+// This doesn't count or time anything, so that it can run in worker threads.
+template <typename Cost>
+vector<typename PathTree<Cost>::Step> shortest_path_steps_without(CompactGraph<Cost> const& g, int s, int skip1, int skip2) {
+  size_t n = g.keys.size();
+  vector<Cost> dist(n);
+  vector<int>  pred(n, -2); // -2 for nodes that are not reached
+  priority_queue<pair<Cost,int>> pq;
+  dist[s] = Cost(0);
+  pred[s] = -1;
+  pq.push(make_pair(Cost(0), s));
+  while (!pq.empty()) {
+    Cost d = -pq.top().first;
+    int  v = pq.top().second;
+    pq.pop();
+    if (dist[v] < d) continue;
+    for (int k = g.start[v]; k < g.start[v+1]; ++k) {
+      if (k == skip1 || k == skip2) continue;
+      int  w  = g.to[k];
+      Cost dw = d + g.cost[k];
+      if (pred[w] == -2 || dw < dist[w]) {
+        dist[w] = dw;
+        pred[w] = v;
+        pq.push(make_pair(-dw, w));
+      }
+    }
+  }
+  vector<typename PathTree<Cost>::Step> steps;
+  for (size_t v = 0; v < n; ++v) {
+    if (pred[v] != -2) steps.push_back(typename PathTree<Cost>::Step{g.keys[v], pred[v] >= 0 ? g.keys[pred[v]] : -1, dist[v]});
+  }
+  return steps;
+}
+
+// Shortest path trees of the graph without one copy of an edge a - b.
+// If other copies are left, nothing changes. Otherwise the cached trees that don't use a - b are still right,
+// and only the others are found again, in parallel with --threads.
+template <typename Weights, typename Cost = typename Weights::Cost>
+class TreesWithout {
+ public:
+  TreesWithout(Graph<Weights> const& graph, pair<int,int> edge) : graph(graph), g(compact_graph(graph)) {
+    auto const& e = graph.at(edge.first).edges[edge.second];
+    a = edge.first;
+    b = e.to;
+    gone = e.capacity == 0;
+    skip1 = g.start[index(a)] + edge.second;
+    skip2 = e.rev >= 0 ? g.start[index(b)] + e.rev : -1;
+  }
+  
+  // find the trees from these nodes that are not right anymore
+  void prefetch(vector<int> const& sources) {
+    vector<int> todo;
+    for (int s : sources) {
+      if (!usable(s) && !fresh.count(s) && find(todo.begin(), todo.end(), s) == todo.end()) todo.push_back(s);
+    }
+    if (todo.empty()) return;
+    ScopedTimer timer(PHASE_SHORTEST_PATHS);
+    count(COUNT_SENSITIVITY_TREES, (long)todo.size());
+    vector<vector<typename PathTree<Cost>::Step>> steps(todo.size());
+    atomic<size_t> next(0);
+    // a checked cost can overflow in any thread, the error is thrown again here after all threads are done
+    exception_ptr error;
+    mutex error_mutex;
+    auto worker = [&]() {
+      try {
+        for (size_t t; (t = next++) < todo.size(); ) steps[t] = shortest_path_steps_without(g, index(todo[t]), skip1, skip2);
+      } catch (...) {
+        lock_guard<mutex> lock(error_mutex);
+        if (!error) error = current_exception();
+        next = todo.size();
+      }
+    };
+    vector<thread> threads;
+    for (int t = 1; t < min(num_threads, (int)todo.size()); ++t) threads.push_back(phase_thread(worker));
+    worker();
+    for (auto& th : threads) th.join();
+    if (error) rethrow_exception(error);
+    for (size_t t = 0; t < todo.size(); ++t) fresh[todo[t]].steps.assign(steps[t].begin(), steps[t].end());
+  }
+  
+  PathTree<Cost> const& operator()(int s) {
+    if (!gone) return shortest_path_tree(graph, s);
+    if (usable(s)) return *path_tree_cache(graph).get(s);
+    prefetch(vector<int>(1, s));
+    return fresh[s];
   }
-  bool brute_force = argv[1][0] == 'b' || argv[1][0] == 'B' || argv[1][0] == '0';
-  int problem = 1;
-  if (argc >= 3) problem = string(argv[2]) == "1" ? 1 : 2;
-  string input = "-";
-  if (argc >= 4) input = argv[3];
   
-  // Parse input
-  auto f = stdin;
-  if (input != "-") {
-    f = fopen(input.c_str(),"rt");
+ private:
+  Graph<Weights> const& graph;
+  CompactGraph<Cost> const& g;
+  int  a, b, skip1, skip2;
+  bool gone;
+  map<int,PathTree<Cost>> fresh;
+  
+  int index(int i) const { return (int)(lower_bound(g.keys.begin(), g.keys.end(), i) - g.keys.begin()); }
+  // the cached tree from s is right without the edge
+  bool usable(int s) {
+    if (!gone) return true;
+    if (!path_tree_cache(graph).contains(s)) return false;
+    PathTree<Cost> const& tree = *path_tree_cache(graph).get(s);
+    auto sa = tree.find(a), sb = tree.find(b);
+    return !(sa && sa->prev == b) && !(sb && sb->prev == a);
+  }
+};
+
+// For every edge, the longest path from i0 (or circuit, if answers only has i0) when one copy of the edge is lost.
+// answers are the longest paths to every node in the whole graph. Losing an edge can't make a path longer, so these are bounds:
+// the targets are tried from the best down, until the best answer so far is at least the bound of the next target.
+// If the path to a target doesn't use the edge, it is still there, and is not searched again. Only otherwise the target is
+// solved again, reusing the shortest path trees that don't use the edge.
+template <typename Weights, typename Cost = typename Weights::Cost>
+vector<EdgeSensitivity<Cost>> edge_sensitivity(Graph<Weights>& graph, int i0, map<int,Cost> const& answers) {
+  vector<pair<int,int>> edges = edge_list(graph);
+  vector<EdgeSensitivity<Cost>> result;
+  for (auto const& edge : edges) result.push_back(EdgeSensitivity<Cost>{edge.first, graph.at(edge.first).edges[edge.second].to, Cost(0)});
+  vector<char> done(edges.size());
+  size_t open = edges.size();
+  
+  vector<pair<Cost,int>> targets;
+  for (auto const& a : answers) {
+    if (!(a.second < Cost(0))) targets.push_back(make_pair(a.second, a.first));
+  }
+  sort(targets.begin(), targets.end(), [](pair<Cost,int> const& x, pair<Cost,int> const& y) { return y.first < x.first; });
+  
+  for (auto const& target : targets) {
+    if (open == 0) break;
+    Cost bound = target.first;
+    int i1 = target.second;
+    ScopedTrace trace("sensitivity", i1);
+    // which edges the path to i1 uses
+    mark_removed_edges(graph, i0, i1, (ContractionHierarchy<Weights> const*)nullptr);
+    set<int> component;
+    component_cost(graph, i0, component);
+    vector<size_t> again;
+    for (size_t x = 0; x < edges.size(); ++x) {
+      if (done[x]) continue;
+      auto const& e = graph.at(edges[x].first).edges[edges[x].second];
+      if (!(result[x].answer < bound)) {
+        done[x] = true; // no other target can do better
+        open--;
+      } else if (e.marked >= e.capacity || !component.count(edges[x].first)) {
+        result[x].answer = bound;
+        done[x] = true;
+        open--;
+      } else {
+        again.push_back(x);
+      }
+    }
+    LOG(LOG_QUERY, LOG_DEBUG, "sensitivity of %d -> %d: %d edges to solve again, %d open", i0, i1, (int)again.size(), (int)open);
+    for (size_t x : again) {
+      count(COUNT_SENSITIVITY_SOLVES);
+      change_capacity(graph, edges[x], -1);
+      TreesWithout<Weights> trees(graph, edges[x]);
+      vector<int> sources = exposed_nodes(graph, i0, i1);
+      sources.push_back(i0);
+      trees.prefetch(sources);
+      Cost answer(-1);
+      if (trees(i0).find(i1)) {
+        mark_removed_edges(graph, i0, i1, (ContractionHierarchy<Weights> const*)nullptr, trees);
+        answer = remaining_cost(graph, i0, i1);
+      }
+      change_capacity(graph, edges[x], +1);
+      result[x].answer = max(result[x].answer, answer);
+    }
+  }
+  return result;
+}
+
+// The same with the brute force, which just solves the whole problem again without each edge
+template <typename Weights, typename Cost = typename Weights::Cost>
+vector<EdgeSensitivity<Cost>> edge_sensitivity_brute(Graph<Weights>& graph, int i0, bool circuit) {
+  vector<EdgeSensitivity<Cost>> result;
+  for (auto const& edge : edge_list(graph)) {
+    change_capacity(graph, edge, -1);
+    map<int,Cost> dist = longest_paths_brute(graph, i0);
+    Cost answer(0);
+    for (auto const& d : dist) {
+      if (!circuit || d.first == i0) answer = max(answer, d.second);
+    }
+    change_capacity(graph, edge, +1);
+    result.push_back(EdgeSensitivity<Cost>{edge.first, graph.at(edge.first).edges[edge.second].to, answer});
   }
-  map<int,Node> graph;
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+// Results
+// -----------------------------------------------------------------------------
+
+struct GraphStats {
+  int  nodes;
+  long edges;
+  long self_loops;
+  int  odd_degree_nodes;
+  int  max_degree;
+  string total_cost; // as JSON
+};
+
+template <typename Weights, typename Cost = typename Weights::Cost>
+GraphStats graph_stats(Graph<Weights> const& graph) {
+  GraphStats stats = {(int)graph.size(), 0, 0, 0, 0, ""};
+  Cost total_cost(0);
+  // arcs of a directed graph are only stored at the node they leave
+  map<int,int> arcs_in;
+  if (directed) {
+    for (auto const& node : graph) {
+      for (auto const& e : node.second.edges) arcs_in[e.to] += e.capacity;
+    }
+  }
+  for (auto const& node : graph) {
+    int degree = node.second.degree();
+    stats.edges += degree;
+    if (directed) {
+      // nodes that don't have as many arcs in as out
+      stats.odd_degree_nodes += degree != arcs_in[node.first];
+      degree += arcs_in[node.first];
+    } else {
+      stats.odd_degree_nodes += degree % 2;
+    }
+    stats.max_degree = max(stats.max_degree, degree);
+    for (auto const& e : node.second.edges) {
+      if (e.to == node.first) stats.self_loops += e.capacity;
+      total_cost += cost_times(e.cost(node.first), e.capacity);
+    }
+  }
+  if (!directed) {
+    // all edges were counted from both ends, and self loops are stored twice
+    stats.edges /= 2;
+    stats.self_loops /= 2;
+    total_cost = total_cost / Cost(2);
+  }
+  stats.total_cost = cost_to_json(total_cost);
+  return stats;
+}
+
+// Write the result of a run, and everything we know about it, as JSON
+template <typename Weights, typename Cost = typename Weights::Cost>
+void print_json_result(FILE* out, string const& engine, int problem, string const& mode, Graph<Weights> const& graph, Cost answer,
+                       vector<EdgeSensitivity<Cost>> const& sensitivity) {
+  GraphStats g = graph_stats(graph);
+  fprintf(out, "{\n");
+  fprintf(out, "  \"answer\": %s,\n", cost_to_json(answer).c_str());
+  fprintf(out, "  \"engine\": \"%s\",\n", engine.c_str());
+  fprintf(out, "  \"problem\": %d,\n", problem);
+  fprintf(out, "  \"mode\": \"%s\",\n", mode.c_str());
+  fprintf(out, "  \"cost_type\": \"%s\",\n", cost_type_names[CostTraits<Cost>::type]);
+  fprintf(out, "  \"weights\": \"%s\",\n", weight_policy_names[Weights::policy]);
+  fprintf(out, "  \"directed\": %s,\n", directed ? "true" : "false");
+  fprintf(out, "  \"graph\": {\"nodes\": %d, \"edges\": %ld, \"self_loops\": %ld, \"odd_degree_nodes\": %d, \"max_degree\": %d, \"total_cost\": %s},\n",
+          g.nodes, g.edges, g.self_loops, g.odd_degree_nodes, g.max_degree, g.total_cost.c_str());
+  if (!sensitivity.empty()) {
+    fprintf(out, "  \"sensitivity\": [");
+    for (size_t k = 0; k < sensitivity.size(); ++k) {
+      fprintf(out, "%s\n    {\"edge\": \"%d/%d\", \"answer\": %s}", k ? "," : "", sensitivity[k].i, sensitivity[k].j,
+              cost_to_json(sensitivity[k].answer).c_str());
+    }
+    fprintf(out, "\n  ],\n");
+  }
+  print_stats_json_members(out, "  ");
+  fprintf(out, ",\n");
+#ifdef __VERSION__
+  const char* compiler = __VERSION__;
+#else
+  const char* compiler = "unknown";
+#endif
+#ifdef __OPTIMIZE__
+  const bool optimized = true;
+#else
+  const bool optimized = false;
+#endif
+  fprintf(out, "  \"build\": {\"compiler\": \"%s\", \"optimized\": %s, \"counters\": %s, \"date\": \"%s %s\"}\n",
+          compiler, optimized ? "true" : "false", COUNTERS ? "true" : "false", __DATE__, __TIME__);
+  fprintf(out, "}\n");
+}
+
+// -----------------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------------
+
+// Edge weight according to AoC2017-24 problem.
+// This is the same for both problems, in problem 2 the number of edges is compared first (with the lex cost type).
+int64_t edge_cost(int i, int j) {
+  return i+j;
+}
+
+// Edges as read from the input, before the cost type is known
+struct InputEdge {
+  int     i, j;
+  int64_t cost;
+  int     capacity; // how many times the edge can be used
+};
+
+// Capacities are stored in 16 bits with every edge
+const int MAX_CAPACITY = 65535;
+
+struct InputGraph {
+  vector<InputEdge,CountingAllocator<InputEdge,MEM_GRAPH>> edges;
+  vector<double,CountingAllocator<double,MEM_GRAPH>> real_costs; // costs of all edges, only if some cost is not an integer
+  bool implicit_costs = true; // no edge has an explicit cost
+
+  void add(int i, int j, int64_t cost, int capacity = 1) {
+    edges.push_back(InputEdge{i,j,cost,capacity});
+    if (!real_costs.empty()) real_costs.push_back((double)cost);
+    implicit_costs = false;
+  }
+  void add_implicit(int i, int j, int capacity = 1) {
+    bool implicit = implicit_costs;
+    add(i, j, edge_cost(i,j), capacity);
+    implicit_costs = implicit;
+  }
+  void add_real(int i, int j, double cost, int capacity = 1) {
+    implicit_costs = false;
+    if (real_costs.empty()) {
+      for (auto const& e : edges) real_costs.push_back((double)e.cost);
+    }
+    edges.push_back(InputEdge{i,j,(int64_t)cost,capacity});
+    real_costs.push_back(cost);
+  }
+};
+
+// The binary format (as written by generate --binary) is the magic string "LPG1",
+// followed by records of three int32s: i, j, cost. A cost of BINARY_IMPLICIT_COST (INT32_MIN) means that the cost
+// is implicit, every other value is an explicit cost, negative ones too.
+const char BINARY_MAGIC[4] = {'L','P','G','1'};
+const int32_t BINARY_IMPLICIT_COST = numeric_limits<int32_t>::min();
+
+void read_binary_graph(FILE* f, InputGraph& input) {
+  char magic[sizeof(BINARY_MAGIC)-1];
+  if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) || !equal(magic, magic + sizeof(magic), BINARY_MAGIC + 1)) {
+    throw "Invalid binary graph";
+  }
+  const size_t record_size = 3 * sizeof(int32_t);
+  int32_t records[3 * 1024];
+  // read bytes rather than records, so that a partial record at the end of the file is noticed
+  size_t have = 0, n;
+  while ((n = fread((char*)records + have, 1, sizeof(records) - have, f)) > 0) {
+    have += n;
+    size_t whole = have / record_size;
+    for (size_t r = 0; r < whole; ++r) {
+      int i = records[3*r], j = records[3*r+1], cost = records[3*r+2];
+      if (cost == BINARY_IMPLICIT_COST) {
+        input.add_implicit(i, j);
+      } else {
+        input.add(i, j, cost);
+      }
+    }
+    have -= whole * record_size;
+    memmove(records, records + 3*whole, have);
+  }
+  if (ferror(f) || have != 0) throw "Invalid binary graph";
+}
+
+// Read a graph, in the format "i/j" or "i/j@cost" with one edge per line, or in the binary format.
+// An edge that can be used c times is written "i/j*c" or "i/j@cost*c", which is the same as c copies of the line.
+InputGraph read_graph(FILE* f) {
+  ScopedTimer timer(PHASE_PARSE);
+  InputGraph input;
+  int c = getc(f);
+  if (c == BINARY_MAGIC[0]) {
+    read_binary_graph(f, input);
+    LOG(LOG_PARSE, LOG_INFO, "read %d edges (binary)", (int)input.edges.size());
+    return input;
+  }
+  ungetc(c, f);
   while (1) {
-    int i, j, cost;
+    int i, j, capacity = 1;
+    char cost[64];
     if (fscanf(f,"%d/%d\n",&i,&j) == 2) {
-      if (fscanf(f,"@%d",&cost) != 1) {
-        cost = edge_cost(problem,i,j);
+      bool explicit_cost = fscanf(f,"@%63[-+.0-9eE]",cost) == 1;
+      if (fscanf(f,"*%d",&capacity) == 1 && (capacity < 1 || capacity > MAX_CAPACITY)) {
+        throw "Edge capacity must be between 1 and 65535";
+      }
+      if (!explicit_cost) {
+        input.add_implicit(i, j, capacity);
+      } else {
+        char* end;
+        errno = 0;
+        long long integer = strtoll(cost, &end, 10);
+        if (*end == '\0' && errno == 0) {
+          input.add(i, j, integer, capacity);
+        } else {
+          input.add_real(i, j, strtod(cost, nullptr), capacity);
+        }
       }
-      graph[i].edges.push_back(Edge{j,cost});
-      graph[j].edges.push_back(Edge{i,cost});
-      if (VERBOSE) printf("%d - %d: %d\n",i,j,cost);
     } else {
       break;
     }
   }
-  if (f != stdin) fclose(f);
+  LOG(LOG_PARSE, LOG_INFO, "read %d edges", (int)input.edges.size());
+  return input;
+}
+
+// Bound on the weight of any set of edges, returns false on overflow
+bool total_weight(InputGraph const& input, int64_t& total) {
+  total = 0;
+  bool overflow = false;
+  for (auto const& e : input.edges) {
+    int64_t cost;
+    overflow |= __builtin_mul_overflow(e.cost < 0 ? -e.cost : e.cost, (int64_t)e.capacity, &cost);
+    overflow |= __builtin_add_overflow(total, cost, &total);
+  }
+  // longest_path_to counts every edge from both ends
+  overflow |= __builtin_add_overflow(total, total, &total);
+  return !overflow;
+}
+
+// The smallest cost type that can hold the length of any path in the graph
+CostType select_cost_type(InputGraph const& input, int problem) {
+  if (problem == 2) return COST_LEX;
+  if (!input.real_costs.empty()) return COST_DOUBLE;
+  int64_t total;
+  if (!total_weight(input, total)) {
+    fprintf(stderr, "Warning: total weight of the graph does not fit in 64 bits, using double costs\n");
+    return COST_DOUBLE;
+  }
+  return total <= INT32_MAX ? COST_INT32 : COST_INT64;
+}
+
+// Use just enough bits for the weights in Lex costs that sums of weights can't carry into the edge count,
+// and check that the edge count fits in the remaining bits.
+void select_lex_weight_bits(InputGraph const& input) {
+  if (!input.real_costs.empty()) throw "The lex cost type needs integer edge costs";
+  int64_t total;
+  if (!total_weight(input, total)) throw "Total weight of the graph is too large for the lex cost type";
+  int bits = 1;
+  while (bits < 62 && ((int64_t)1 << (bits - 1)) <= total) ++bits;
+  // every copy of every edge counted from both ends, plus the weight part
+  int64_t edges = 1;
+  for (auto const& e : input.edges) edges += 2 * (int64_t)e.capacity;
+  if (bits >= 62 || edges > (INT64_MAX >> bits)) throw "Graph is too large for the lex cost type";
+  Lex::weight_bits = bits;
+  LOG(LOG_PARSE, LOG_INFO, "lex cost: %d weight bits", bits);
+}
+
+void edge_cost_range(InputGraph const& input, int64_t& min_cost, int64_t& max_cost) {
+  min_cost = max_cost = 0;
+  for (auto const& e : input.edges) {
+    min_cost = min(min_cost, e.cost);
+    max_cost = max(max_cost, e.cost);
+  }
+  for (double c : input.real_costs) {
+    if (c < 0) min_cost = -1;
+  }
+}
+
+// Explicit costs only need to be stored if they are not all the same
+WeightPolicy select_weight_policy(InputGraph const& input) {
+  if (input.implicit_costs) return WEIGHTS_PORT_SUM;
+  if (!input.real_costs.empty() || input.edges.empty()) return WEIGHTS_EXPLICIT;
+  int64_t common = input.edges[0].cost;
+  if (common <= 0) return WEIGHTS_EXPLICIT;
+  for (auto const& e : input.edges) {
+    if (e.cost != common) return WEIGHTS_EXPLICIT;
+  }
+  unit_edge_cost = common;
+  return WEIGHTS_UNIT;
+}
+
+template <typename Weights, typename Cost = typename Weights::Cost>
+void add_edge(Graph<Weights>& graph, int i, int j, Cost cost, int capacity) {
+  auto& edges_i = graph[i].edges;
+  auto& edges_j = graph[j].edges;
+  // for a self loop (i==j) both ends are in the same list
+  int rev_i = (int)edges_j.size() + (i == j ? 1 : 0);
+  edges_i.push_back(Edge<Weights>(cost, j, rev_i, capacity));
+  edges_j.push_back(Edge<Weights>(cost, i, (int)edges_i.size()-1, capacity));
+  LOG(LOG_PARSE, LOG_TRACE, "%d - %d: %s x%d", i, j, cost_to_string(cost).c_str(), capacity);
+}
+template <typename Weights, typename Cost = typename Weights::Cost>
+void add_arc(Graph<Weights>& graph, int i, int j, Cost cost, int capacity) {
+  graph[j]; // j is a node even if no arcs leave it
+  graph[i].edges.push_back(Edge<Weights>(cost, j, -1, capacity));
+  LOG(LOG_PARSE, LOG_TRACE, "%d -> %d: %s x%d", i, j, cost_to_string(cost).c_str(), capacity);
+}
+
+template <typename Weights, typename Cost = typename Weights::Cost>
+Graph<Weights> build_graph(InputGraph const& input) {
+  ScopedTimer timer(PHASE_PARSE);
+  Graph<Weights> graph;
+  for (size_t k = 0; k < input.edges.size(); ++k) {
+    auto const& e = input.edges[k];
+    Cost cost = input.real_costs.empty() ? edge_cost_as<Cost>(e.cost) : edge_cost_as<Cost>(input.real_costs[k]);
+    if (edge_weight(cost) != (input.real_costs.empty() ? (double)e.cost : input.real_costs[k])) {
+      throw "Edge cost does not fit in the cost type";
+    }
+    if (directed) {
+      add_arc(graph, e.i, e.j, cost, e.capacity);
+    } else {
+      add_edge(graph, e.i, e.j, cost, e.capacity);
+    }
+  }
+  return graph;
+}
+
+// -----------------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------------
+
+// What to look for: the longest trail starting at node 0, the longest closed trail through node 0, or anywhere,
+// or the shortest closed walk from node 0 that uses every edge
+enum Mode {
+  MODE_PATH,
+  MODE_CIRCUIT,
+  MODE_ANY_CIRCUIT,
+  MODE_POSTMAN,
+};
+const char* mode_names[] = {"path", "circuit", "any-circuit", "postman"};
+const char* mode_results[] = {"longest path", "longest circuit", "longest circuit", "shortest postman walk"};
 
-  printf("%d nodes\n", (int)graph.size());
+struct Options {
+  bool     brute_force = false;
+  int      problem = 1;
+  Mode     mode = MODE_PATH;
+  bool     json = false;
+  bool     stats_json = false;
+  string   trace_file;
+  string   walk_file;
+  bool     sensitivity = false;
+  CostType cost_type = COST_AUTO;
+};
+
+// Write a walk, one node per line
+void write_walk(string const& path, vector<int> const& walk) {
+  FILE* out = fopen(path.c_str(), "w");
+  if (!out) throw "Can't write the walk";
+  for (int i : walk) fprintf(out, "%d\n", i);
+  fclose(out);
+}
+
+template <typename Weights, typename Cost = typename Weights::Cost>
+void run(Options const& opt, InputGraph& input) {
+  Graph<Weights> graph = build_graph<Weights>(input);
+  input = InputGraph(); // not needed anymore
+  graph_size = graph.size();
+
+  if (!opt.json) printf("%d nodes\n", (int)graph.size());
 
   // Brute force
   map<int,Cost> dists;
-  if (brute_force) {
-    dists = longest_paths_brute(graph, 0);
+  if (opt.brute_force) {
+    if (opt.mode == MODE_PATH) {
+      dists = longest_paths_brute(graph, 0);
+    } else if (opt.mode == MODE_POSTMAN) {
+      dists[0] = postman_brute(graph, 0);
+    } else {
+      // a closed trail from i to i, through node 0 or through any node
+      for (auto const& node : graph) {
+        if (opt.mode == MODE_CIRCUIT && node.first != 0) continue;
+        dists[node.first] = longest_paths_brute(graph, node.first)[node.first];
+      }
+    }
   } else {
-    dists = longest_paths(graph,0);
+    // the contraction hierarchy is built once, and used for all queries
+    unique_ptr<ContractionHierarchy<Weights>> ch;
+    if (shortest_path_algorithm == SSSP_CH) ch.reset(new ContractionHierarchy<Weights>(graph));
+    switch (opt.mode) {
+      case MODE_PATH:        dists = longest_paths(graph, 0, ch.get()); break;
+      case MODE_CIRCUIT:     dists[0] = longest_circuit(graph, 0, ch.get()); break;
+      case MODE_ANY_CIRCUIT: if (!graph.empty()) dists[-1] = longest_any_circuit(graph, ch.get()); break;
+      case MODE_POSTMAN: {
+        vector<int> walk;
+        dists[0] = postman_walk(graph, 0, ch.get(), walk);
+        if (!opt.walk_file.empty()) write_walk(opt.walk_file, walk);
+        break;
+      }
+    }
   }
-  Cost largest = 0;
+  Cost largest(0);
   for (auto const& d : dists) {
-    if (VERBOSE) {
-      printf("%d -> %d: %d\n", 0, d.first, d.second);
-    }
+    LOG(LOG_QUERY, LOG_INFO, "%d -> %d: %s", opt.mode == MODE_PATH ? 0 : d.first, d.first, cost_to_string(d.second).c_str());
     largest = max(largest, d.second);
   }
-  printf("longest path length: %d\n", largest);
+  
+  // The answer without each edge
+  vector<EdgeSensitivity<Cost>> sensitivity;
+  if (opt.sensitivity) {
+    if (opt.brute_force) {
+      sensitivity = edge_sensitivity_brute(graph, 0, opt.mode == MODE_CIRCUIT);
+    } else {
+      sensitivity = edge_sensitivity(graph, 0, dists);
+    }
+  }
+  
+  if (opt.json) {
+    print_json_result(stdout, opt.brute_force ? "brute" : "fast", opt.problem, mode_names[opt.mode], graph, largest, sensitivity);
+  } else {
+    printf("%s length: %s\n", mode_results[opt.mode], cost_to_string(largest).c_str());
+    if (opt.sensitivity) {
+      printf("without one copy of each edge, worst first:\n");
+      stable_sort(sensitivity.begin(), sensitivity.end(), [](EdgeSensitivity<Cost> const& a, EdgeSensitivity<Cost> const& b) {
+        return a.answer < b.answer;
+      });
+      for (auto const& s : sensitivity) {
+        printf("  %d/%d: %s\n", s.i, s.j, cost_to_string(s.answer).c_str());
+      }
+    }
+  }
+}
+
+template <typename Cost>
+void run(Options const& opt, InputGraph& input, WeightPolicy weights) {
+  switch (weights) {
+    case WEIGHTS_EXPLICIT: run<ExplicitWeights<Cost>>(opt, input); break;
+    case WEIGHTS_PORT_SUM: run<PortSumWeights<Cost>>(opt, input); break;
+    case WEIGHTS_UNIT:     run<UnitWeights<Cost>>(opt, input); break;
+  }
 }
 
+int main(int argc, const char** argv) {
+  // Usage: longest-path [options] <brute> <input>
+  // Parse arguments
+  Options opt;
+  vector<string> args;
+  for (int a = 1; a < argc; ++a) {
+    string arg = argv[a];
+    if (arg.compare(0, 6, "--log=") == 0) {
+      if (!parse_log_spec(arg.substr(6))) {
+        fprintf(stderr, "Invalid log specification: %s\n", arg.c_str() + 6);
+        return EXIT_FAILURE;
+      }
+    } else if (arg.compare(0, 8, "--trace=") == 0) {
+      collect_trace = true;
+      opt.trace_file = arg.substr(8);
+    } else if (arg.compare(0, 7, "--cost=") == 0) {
+      auto name = find(begin(cost_type_names), end(cost_type_names), arg.substr(7));
+      if (name == end(cost_type_names)) {
+        fprintf(stderr, "Invalid cost type: %s\n", arg.c_str() + 7);
+        return EXIT_FAILURE;
+      }
+      opt.cost_type = (CostType)(name - begin(cost_type_names));
+    } else if (arg.compare(0, 7, "--sssp=") == 0) {
+      auto name = find(begin(shortest_path_algorithm_names), end(shortest_path_algorithm_names), arg.substr(7));
+      if (name == end(shortest_path_algorithm_names)) {
+        fprintf(stderr, "Invalid shortest path algorithm: %s\n", arg.c_str() + 7);
+        return EXIT_FAILURE;
+      }
+      shortest_path_algorithm = (ShortestPathAlgorithm)(name - begin(shortest_path_algorithm_names));
+    } else if (arg.compare(0, 7, "--mode=") == 0) {
+      auto name = find(begin(mode_names), end(mode_names), arg.substr(7));
+      if (name == end(mode_names)) {
+        fprintf(stderr, "Invalid mode: %s\n", arg.c_str() + 7);
+        return EXIT_FAILURE;
+      }
+      opt.mode = (Mode)(name - begin(mode_names));
+    } else if (arg == "--sensitivity") {
+      opt.sensitivity = true;
+    } else if (arg.compare(0, 7, "--walk=") == 0) {
+      opt.walk_file = arg.substr(7);
+    } else if (arg == "--directed") {
+      directed = true;
+    } else if (arg.compare(0, 10, "--threads=") == 0) {
+      num_threads = max(1, atoi(arg.c_str() + 10));
+    } else if (arg.compare(0, 8, "--delta=") == 0) {
+      delta_step = atof(arg.c_str() + 8);
+    } else if (arg == "--json") {
+      opt.json = true;
+      collect_stats = true;
+    } else if (arg == "--perf") {
+      collect_stats = true;
+      collect_hardware = open_hardware_counters();
+    } else if (arg == "--memory") {
+      collect_stats = collect_memory = true;
+    } else if (arg.compare(0, 15, "--memory-limit=") == 0) {
+      collect_stats = collect_memory = true;
+      distance_cache_limit = (long)(atof(arg.c_str() + 15) * 1048576);
+    } else if (arg.compare(0, 13, "--tree-cache=") == 0) {
+      path_tree_cache_budget = (size_t)(atof(arg.c_str() + 13) * 1048576);
+    } else if (arg == "--stats") {
+      collect_stats = true;
+    } else if (arg == "--stats=json") {
+      collect_stats = true;
+      opt.stats_json = true;
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.size() < 1) {
+    fprintf(stderr, "Usage: %s [--json] [--stats[=json]] [--memory] [--memory-limit=MB] [--tree-cache=MB] [--perf] [--trace=FILE] [--log=CATEGORY[:LEVEL],...] [--cost=TYPE] [--sssp=ALGORITHM] [--threads=N] [--delta=D] [--directed] [--mode=MODE] [--walk=FILE] [--sensitivity] {brute|fast} [PROBLEM={1|2}] [FILE]\n", argv[0]);
+    fprintf(stderr, "Log categories: all parse dijkstra matching marking brute query, levels: off info debug trace\n");
+    fprintf(stderr, "Cost types: auto (default) int32 int64 double checked32 checked64 lex\n");
+    fprintf(stderr, "Shortest path algorithms: auto (default) dijkstra bfs buckets floyd ch delta\n");
+    fprintf(stderr, "Modes: path (default) circuit any-circuit postman\n");
+    return EXIT_FAILURE;
+  }
+  opt.brute_force = args[0][0] == 'b' || args[0][0] == 'B' || args[0][0] == '0';
+  if (args.size() >= 2) opt.problem = args[1] == "1" ? 1 : 2;
+  string input_file = "-";
+  if (args.size() >= 3) input_file = args[2];
+  
+  try {
+    // Parse input
+    auto f = stdin;
+    if (input_file != "-") {
+      f = fopen(input_file.c_str(),"rb");
+    }
+    InputGraph input = read_graph(f);
+    if (f != stdin) fclose(f);
+
+    CostType cost_type = opt.cost_type == COST_AUTO ? select_cost_type(input, opt.problem) : opt.cost_type;
+    if (opt.problem == 2 && cost_type != COST_LEX) throw "Problem 2 needs the lex cost type";
+    if (cost_type == COST_LEX) select_lex_weight_bits(input);
+    WeightPolicy weights = select_weight_policy(input);
+    if (shortest_path_algorithm == SSSP_BFS && weights != WEIGHTS_UNIT) throw "BFS needs edges that all have the same cost";
+    edge_cost_range(input, min_edge_cost, max_edge_cost);
+    if (shortest_path_algorithm == SSSP_BUCKETS) {
+      if (cost_type == COST_DOUBLE || cost_type == COST_LEX) throw "Buckets need an integer cost type";
+      if (min_edge_cost < 0 || max_edge_cost > MAX_BUCKETS) throw "Edge costs are out of range for buckets";
+    }
+    if (shortest_path_algorithm == SSSP_DELTA && (cost_type == COST_CHECKED32 || cost_type == COST_CHECKED64)) {
+      throw "Delta-stepping doesn't support checked cost types";
+    }
+    if ((shortest_path_algorithm == SSSP_CH || shortest_path_algorithm == SSSP_DELTA) && min_edge_cost < 0) throw "This shortest path algorithm needs non-negative edge costs";
+    if (directed && shortest_path_algorithm == SSSP_CH) throw "Contraction hierarchies need an undirected graph";
+    if (directed && min_edge_cost < 0) throw "Directed graphs need non-negative edge costs";
+    if (opt.mode == MODE_POSTMAN && directed) throw "The postman mode needs an undirected graph";
+    if (opt.mode == MODE_POSTMAN && min_edge_cost < 0) throw "The postman mode needs non-negative edge costs";
+    if (opt.sensitivity && (directed || (opt.mode != MODE_PATH && opt.mode != MODE_CIRCUIT))) {
+      throw "Sensitivity analysis needs an undirected graph, and the path or circuit mode";
+    }
+    if (shortest_path_algorithm == SSSP_FLOYD && cost_type != COST_INT32 && cost_type != COST_INT64) {
+      throw "Floyd-Warshall needs the int32 or int64 cost type";
+    }
+    LOG(LOG_PARSE, LOG_INFO, "cost type: %s, weights: %s", cost_type_names[cost_type], weight_policy_names[weights]);
+    switch (cost_type) {
+      case COST_INT32:     run<int32_t>(opt, input, weights); break;
+      case COST_INT64:     run<int64_t>(opt, input, weights); break;
+      case COST_DOUBLE:    run<double>(opt, input, weights); break;
+      case COST_CHECKED32: run<Checked<int32_t>>(opt, input, weights); break;
+      case COST_CHECKED64: run<Checked<int64_t>>(opt, input, weights); break;
+      case COST_LEX:       run<Lex>(opt, input, weights); break;
+      default: break;
+    }
+  } catch (const char* err) {
+    log_buffer.flush();
+    fprintf(stderr, "Error: %s\n", err);
+    return EXIT_FAILURE;
+  }
+  
+  log_buffer.flush();
+  if (!opt.json && (collect_stats || COUNTERS)) {
+    if (opt.stats_json) {
+      print_stats_json(stderr);
+    } else {
+      print_stats_table(stderr);
+    }
+  }
+  if (collect_trace) {
+    FILE* out = fopen(opt.trace_file.c_str(), "w");
+    if (!out) {
+      perror(opt.trace_file.c_str());
+      return EXIT_FAILURE;
+    }
+    write_trace(out);
+    fclose(out);
+  }
+}